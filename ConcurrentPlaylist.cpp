@@ -0,0 +1,90 @@
+/**
+ * @file ConcurrentPlaylist.cpp
+ * @brief This is the implementation file of the ConcurrentPlaylist interface
+ * @version 0.1
+ * @date 2024-07-14
+ * 
+ * @copyright Copyright (c) 2024
+ * 
+ */
+#include "ConcurrentPlaylist.hpp"
+
+#include <functional>
+#include <mutex>
+#include <string_view>
+#include <utility>
+
+ConcurrentPlaylist::ConcurrentPlaylist(size_t shard_count) : shards_(shard_count == 0 ? 1 : shard_count){
+}
+
+bool ConcurrentPlaylist::add(std::string_view song, std::string_view artist){
+    Shard& shard = shardFor(song, artist);
+    std::unique_lock<std::shared_mutex> lock(shard.mutex_);
+    return shard.songs_.add(song, artist);
+}
+
+bool ConcurrentPlaylist::remove(std::string_view song, std::string_view artist){
+    Shard& shard = shardFor(song, artist);
+    std::unique_lock<std::shared_mutex> lock(shard.mutex_);
+    return shard.songs_.remove(song, artist);
+}
+
+bool ConcurrentPlaylist::search(std::string_view song, std::string_view artist) const{
+    Shard& shard = shardFor(song, artist);
+    std::shared_lock<std::shared_mutex> lock(shard.mutex_);
+    return shard.songs_.search(song, artist);
+}
+
+size_t ConcurrentPlaylist::getNumberOfSongs() const{
+    size_t count = 0;
+    for(Shard& shard : shards_){
+        std::shared_lock<std::shared_mutex> lock(shard.mutex_);
+        count += shard.songs_.getNumberOfSongs();
+    }
+    return count;
+}
+
+bool ConcurrentPlaylist::isEmpty() const{
+    for(Shard& shard : shards_){
+        std::shared_lock<std::shared_mutex> lock(shard.mutex_);
+        if(!shard.songs_.isEmpty()){
+            return false;
+        }
+    }
+    return true;
+}
+
+void ConcurrentPlaylist::clear(){
+    for(Shard& shard : shards_){
+        std::unique_lock<std::shared_mutex> lock(shard.mutex_);
+        shard.songs_.clear();
+    }
+}
+
+Playlist ConcurrentPlaylist::snapshot() const{
+    std::vector<std::pair<std::string, std::string>> songs;
+    std::vector<std::pair<size_t, size_t>> repeats;
+    for(Shard& shard : shards_){
+        std::shared_lock<std::shared_mutex> lock(shard.mutex_);
+        for(const SongNode& song : shard.songs_){
+            //addBatch counts each pair once, so remember where the songs added more than once are to top up their count
+            if(song.count_ > 1){
+                repeats.emplace_back(songs.size(), song.count_ - 1);
+            }
+            songs.emplace_back(song.song(), song.artist());
+        }
+    }
+    Playlist merged;
+    merged.addBatch(songs);
+    for(const auto& repeat : repeats){
+        merged.add(songs[repeat.first].first, songs[repeat.first].second, repeat.second);
+    }
+    return merged;
+}
+
+ConcurrentPlaylist::Shard& ConcurrentPlaylist::shardFor(std::string_view song, std::string_view artist) const{
+    //mix the two hashes so the same title by different artists lands on different shards
+    size_t hash = std::hash<std::string_view>()(song);
+    hash ^= std::hash<std::string_view>()(artist) + 0x9e3779b97f4a7c15ULL + (hash << 6) + (hash >> 2);
+    return shards_[hash % shards_.size()];
+}
@@ -0,0 +1,110 @@
+/**
+ * @file ConcurrentPlaylist.hpp
+ * @brief This is the interface of a thread safe Playlist that splits its songs over independently locked shards
+ * @version 0.1
+ * @date 2024-07-14
+ * 
+ * @copyright Copyright (c) 2024
+ * 
+ */
+
+#ifndef CONCURRENT_PLAYLIST_H_
+#define CONCURRENT_PLAYLIST_H_
+
+#include <cstddef>
+#include <shared_mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "Playlist.hpp"
+
+/**
+ * @brief A Playlist that many threads can use at once.
+ * 
+ * Songs are spread over a fixed number of shards by a hash of the song and artist. Each shard is a Playlist behind its
+ * own reader-writer lock, so searches only share a lock with other operations on the same shard and never wait for
+ * writers on other shards. Each shard sits on its own cache line so the lock words of neighbouring shards do not bounce
+ * between cores.
+ */
+class ConcurrentPlaylist {
+    public:
+        /**
+         * @brief Constructor for ConcurrentPlaylist
+         * @param shard_count Number of independently locked shards, at least 1. More shards means less contention
+         * between threads and a little more memory
+         */
+        explicit ConcurrentPlaylist(size_t shard_count = 64);
+
+        ConcurrentPlaylist(const ConcurrentPlaylist&) = delete;
+        ConcurrentPlaylist& operator=(const ConcurrentPlaylist&) = delete;
+
+        /**
+         * @brief Add a song to the Playlist if the given song and artist is not empty string
+         * @param song The name of the song to be added
+         * @param artist The name of the artist of the song
+         * @return True if the song was successfully added, otherwise false
+         */
+        bool add(std::string_view song, std::string_view artist);
+
+        /**
+         * @brief Remove a song from the Playlist if the song exists in the Playlist
+         * @param song The name of the song to be removed
+         * @param artist The name of the artist of the song
+         * @return True if the song was successfully removed, otherwise false
+         */
+        bool remove(std::string_view song, std::string_view artist);
+
+        /**
+         * @brief Search for a song in the Playlist, only taking a shared lock on one shard
+         * @param song The name of the song to search for
+         * @param artist The name of the artist of the song
+         * @return True if the song was found, otherwise false
+         */
+        bool search(std::string_view song, std::string_view artist) const;
+
+        /**
+         * @brief Get the number of songs in the Playlist. Shards are counted one after the other, so songs added or removed
+         * by other threads during the call may or may not be counted
+         * @return Number of songs in the Playlist
+         */
+        size_t getNumberOfSongs() const;
+
+        /**
+         * @brief Check if the Playlist is empty
+         * @return True if no shard has a song, otherwise false
+         */
+        bool isEmpty() const;
+
+        /**
+         * @brief Clear the Playlist of all songs, one shard at a time
+         */
+        void clear();
+
+        /**
+         * @brief Copy every song into a single Playlist, for traversals and order statistic queries
+         * @return A Playlist with the songs of every shard, read one shard at a time
+         */
+        Playlist snapshot() const;
+
+    private:
+        /**
+         * @brief One independently locked part of the Playlist, padded to a cache line
+         */
+        struct alignas(64) Shard {
+            mutable std::shared_mutex mutex_; /** Shared for searches, exclusive for changes */
+            Playlist songs_; /** The songs that hash to this shard */
+        };
+
+        /**
+         * @brief Pick the shard a song belongs to
+         * @param song The name of the song
+         * @param artist The name of the artist of the song
+         * @return The shard that holds the song if it is in the Playlist
+         */
+        Shard& shardFor(std::string_view song, std::string_view artist) const;
+
+        mutable std::vector<Shard> shards_; /** The shards, never resized after construction so they never move */
+};
+
+#endif//CONCURRENT_PLAYLIST_H_
@@ -0,0 +1,216 @@
+/**
+ * @file FlatPlaylist.cpp
+ * @brief This is the implementation file of the FlatPlaylist interface
+ * @version 0.1
+ * @date 2024-07-14
+ * 
+ * @copyright Copyright (c) 2024
+ * 
+ */
+#include "FlatPlaylist.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <limits>
+#include <stdexcept>
+
+#if defined(__AVX2__) || defined(__SSE4_2__)
+#include <immintrin.h>
+#endif
+
+FlatPlaylist::FlatPlaylist() : strings_(std::make_unique<StringPool>()){
+}
+
+FlatPlaylist::FlatPlaylist(const Playlist& playlist) : strings_(std::make_unique<StringPool>()){
+    if(playlist.getNumberOfSongs() > std::numeric_limits<uint32_t>::max()){
+        throw std::length_error("FlatPlaylist: too many songs for 32 bit slot ranks");
+    }
+    songs_.reserve(playlist.getNumberOfSongs());
+    for(const SongNode& song : playlist){
+        songs_.emplace_back(strings_->store(song.song()), strings_->intern(song.artist()));
+    }
+    //one extra slot because slot 0 is unused
+    lines_.resize((songs_.size() + kSlotsPerLine) / kSlotsPerLine);
+    size_t next_rank = 0;
+    fillSlots(1, next_rank);
+    fillPrefixes(1, std::string_view(), std::string_view());
+}
+
+size_t FlatPlaylist::getNumberOfSongs() const{
+    return songs_.size();
+}
+
+bool FlatPlaylist::isEmpty() const{
+    return songs_.empty();
+}
+
+bool FlatPlaylist::search(std::string_view song, std::string_view artist) const{
+    SongKey key(song, artist);
+    size_t rank = lowerBound(key);
+    return rank < songs_.size() && songs_[rank] == key;
+}
+
+std::vector<bool> FlatPlaylist::searchMany(const std::vector<SongKey>& keys) const{
+    std::vector<bool> found(keys.size());
+    for(size_t first = 0; first < keys.size(); first += kProbeGroupSize){
+        size_t count = std::min(kProbeGroupSize, keys.size() - first);
+        const SongKey* group = keys.data() + first;
+        size_t k[kProbeGroupSize];
+        uint64_t slot_prefixes[kProbeGroupSize] = {};
+        uint64_t key_prefixes[kProbeGroupSize] = {};
+        for(size_t i = 0; i < count; i++){
+            k[i] = 1;
+        }
+        //every probe in a group takes one step per round, so while one waits on a cache line the others keep going.
+        //A complete tree has leaves on its last two levels only, so probes finish within a round of each other
+        bool walking = !songs_.empty();
+        while(walking){
+            for(size_t i = 0; i < count; i++){
+                if(k[i] <= songs_.size()){
+                    const Slot& current = slot(k[i]);
+                    slot_prefixes[i] = current.prefix_;
+                    key_prefixes[i] = prefixOf(group[i].song_, current.offset_);
+                }
+                else{
+                    slot_prefixes[i] = 0;
+                    key_prefixes[i] = 0;
+                }
+            }
+            unsigned before = 0;
+            unsigned tied = 0;
+            comparePrefixes(slot_prefixes, key_prefixes, before, tied);
+            walking = false;
+            for(size_t i = 0; i < count; i++){
+                if(k[i] > songs_.size()){
+                    continue;
+                }
+                bool is_before = (tied >> i) & 1 ? songs_[slot(k[i]).rank_] < group[i] : (before >> i) & 1;
+                k[i] = 2 * k[i] + (is_before ? 1 : 0);
+                if(k[i] <= songs_.size()){
+                    walking = true;
+                    if(k[i] < lines_.size()){
+                        __builtin_prefetch(&lines_[k[i]]);
+                    }
+                }
+            }
+        }
+        for(size_t i = 0; i < count; i++){
+            //same way back up as lowerBound
+            while(k[i] & 1){
+                k[i] >>= 1;
+            }
+            k[i] >>= 1;
+            found[first + i] = k[i] != 0 && songs_[slot(k[i]).rank_] == group[i];
+        }
+    }
+    return found;
+}
+
+size_t FlatPlaylist::rankOf(std::string_view song, std::string_view artist) const{
+    return lowerBound(SongKey(song, artist));
+}
+
+SongKey FlatPlaylist::at(size_t k) const{
+    if(k >= getNumberOfSongs()){
+        throw std::out_of_range("FlatPlaylist::at: position " + std::to_string(k) + " is past the last song");
+    }
+    return songs_[k];
+}
+
+uint64_t FlatPlaylist::prefixOf(std::string_view song, size_t offset){
+    uint64_t prefix = 0;
+#if defined(__GNUC__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    //whole 8 bytes available: one load and a byte swap to put the first byte on top
+    if(offset + sizeof(prefix) <= song.size()){
+        std::memcpy(&prefix, song.data() + offset, sizeof(prefix));
+        return __builtin_bswap64(prefix);
+    }
+#endif
+    for(size_t i = offset; i < offset + sizeof(prefix); i++){
+        //titles compare bytes as unsigned char, and a missing byte orders before every real one like the end of a shorter title
+        unsigned char byte = i < song.size() ? static_cast<unsigned char>(song[i]) : 0;
+        prefix = (prefix << 8) | byte;
+    }
+    return prefix;
+}
+
+void FlatPlaylist::comparePrefixes(const uint64_t* slot_prefixes, const uint64_t* key_prefixes, unsigned& before, unsigned& tied){
+    before = 0;
+    tied = 0;
+#if defined(__AVX2__)
+    //there is no unsigned 64 bit compare, flipping the top bit makes the signed one order the same way
+    const __m256i flip = _mm256_set1_epi64x(static_cast<long long>(1ULL << 63));
+    for(size_t i = 0; i < kProbeGroupSize; i += 4){
+        __m256i slots = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(slot_prefixes + i));
+        __m256i keys = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(key_prefixes + i));
+        __m256i less = _mm256_cmpgt_epi64(_mm256_xor_si256(keys, flip), _mm256_xor_si256(slots, flip));
+        __m256i equal = _mm256_cmpeq_epi64(keys, slots);
+        before |= static_cast<unsigned>(_mm256_movemask_pd(_mm256_castsi256_pd(less))) << i;
+        tied |= static_cast<unsigned>(_mm256_movemask_pd(_mm256_castsi256_pd(equal))) << i;
+    }
+#elif defined(__SSE4_2__)
+    const __m128i flip = _mm_set1_epi64x(static_cast<long long>(1ULL << 63));
+    for(size_t i = 0; i < kProbeGroupSize; i += 2){
+        __m128i slots = _mm_loadu_si128(reinterpret_cast<const __m128i*>(slot_prefixes + i));
+        __m128i keys = _mm_loadu_si128(reinterpret_cast<const __m128i*>(key_prefixes + i));
+        __m128i less = _mm_cmpgt_epi64(_mm_xor_si128(keys, flip), _mm_xor_si128(slots, flip));
+        __m128i equal = _mm_cmpeq_epi64(keys, slots);
+        before |= static_cast<unsigned>(_mm_movemask_pd(_mm_castsi128_pd(less))) << i;
+        tied |= static_cast<unsigned>(_mm_movemask_pd(_mm_castsi128_pd(equal))) << i;
+    }
+#else
+    for(size_t i = 0; i < kProbeGroupSize; i++){
+        before |= static_cast<unsigned>(slot_prefixes[i] < key_prefixes[i]) << i;
+        tied |= static_cast<unsigned>(slot_prefixes[i] == key_prefixes[i]) << i;
+    }
+#endif
+}
+
+void FlatPlaylist::fillSlots(size_t k, size_t& next_rank){
+    if(k > songs_.size()){
+        return;
+    }
+    //an inorder walk of the implicit tree hands out the songs in sorted order
+    fillSlots(2 * k, next_rank);
+    slot(k).rank_ = static_cast<uint32_t>(next_rank);
+    next_rank++;
+    fillSlots(2 * k + 1, next_rank);
+}
+
+void FlatPlaylist::fillPrefixes(size_t k, std::string_view low, std::string_view high){
+    if(k > songs_.size()){
+        return;
+    }
+    //a search only gets here for titles between the two closest ancestors it passed, and those all start with the
+    //prefix the two ancestors share. With a missing ancestor there is no such prefix
+    size_t offset = 0;
+    if(!low.empty() && !high.empty()){
+        offset = std::mismatch(low.begin(), low.begin() + std::min(low.size(), high.size()), high.begin()).first - low.begin();
+    }
+    std::string_view song = songs_[slot(k).rank_].song_;
+    slot(k).prefix_ = prefixOf(song, offset);
+    slot(k).offset_ = static_cast<uint32_t>(offset);
+    fillPrefixes(2 * k, low, song);
+    fillPrefixes(2 * k + 1, song, high);
+}
+
+size_t FlatPlaylist::lowerBound(const SongKey& key) const{
+    size_t k = 1;
+    while(k <= songs_.size()){
+        //the four grandchildren of slot k are exactly line k, fetch it while this level and the next are compared
+        if(k < lines_.size()){
+            __builtin_prefetch(&lines_[k]);
+        }
+        const Slot& current = slot(k);
+        uint64_t prefix = prefixOf(key.song_, current.offset_);
+        bool is_before = current.prefix_ != prefix ? current.prefix_ < prefix : songs_[current.rank_] < key;
+        k = 2 * k + (is_before ? 1 : 0);
+    }
+    //k walked off the tree. Drop the right turns taken since the last left turn, and that one too, to get back to the
+    //last slot that was not before the key. Only the root path has no left turn, and it leaves 0
+    while(k & 1){
+        k >>= 1;
+    }
+    k >>= 1;
+    return k == 0 ? songs_.size() : slot(k).rank_;
+}
@@ -0,0 +1,177 @@
+/**
+ * @file FlatPlaylist.hpp
+ * @brief This is the interface of a frozen, read only copy of a Playlist laid out in flat arrays for fast lookups
+ * @version 0.1
+ * @date 2024-07-14
+ * 
+ * @copyright Copyright (c) 2024
+ * 
+ */
+
+#ifndef FLAT_PLAYLIST_H_
+#define FLAT_PLAYLIST_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "Playlist.hpp"
+#include "StringPool.hpp"
+
+/**
+ * @brief A read only snapshot of a Playlist for playlists that are searched far more often than they change.
+ * 
+ * The search tree is stored in Eytzinger order: the root at slot 1 and the children of slot k at slots 2k and 2k + 1,
+ * so a search walks down one array with no pointers to chase. Each slot holds 8 bytes of the song title packed into
+ * an integer, so most steps are decided by one integer compare on the slot itself, and only ties read the full names.
+ * Deep in the tree neighbouring titles share long prefixes, so the 8 bytes start where the titles that can still
+ * reach the slot stop agreeing. Four slots share a cache line, so the grandchildren of a slot are one line that is
+ * prefetched two levels before the search needs it.
+ * 
+ * Changes to the Playlist after the snapshot is taken are not seen. Build a new FlatPlaylist to pick them up.
+ */
+class FlatPlaylist {
+    public:
+        using const_iterator = std::vector<SongKey>::const_iterator;
+
+        /**
+         * @brief Default constructor for FlatPlaylist, an empty snapshot
+         */
+        FlatPlaylist();
+
+        /**
+         * @brief Constructor that takes a snapshot of a Playlist in O(n), copying the names so the Playlist can change afterwards
+         * @param playlist The Playlist to take the songs from
+         * @throw std::length_error if the Playlist holds 2^32 songs or more
+         */
+        explicit FlatPlaylist(const Playlist& playlist);
+
+        FlatPlaylist(const FlatPlaylist&) = delete;
+        FlatPlaylist& operator=(const FlatPlaylist&) = delete;
+        FlatPlaylist(FlatPlaylist&&) = default;
+        FlatPlaylist& operator=(FlatPlaylist&&) = default;
+
+        /**
+         * @brief Get the number of songs in the snapshot
+         * @return Number of songs in the snapshot
+         */
+        size_t getNumberOfSongs() const;
+
+        /**
+         * @brief Check if the snapshot is empty
+         * @return True if the snapshot holds no songs, otherwise false
+         */
+        bool isEmpty() const;
+
+        /**
+         * @brief Search for a song in O(log n), reading a full name only when the title prefixes tie
+         * @param song The name of the song to search for
+         * @param artist The name of the artist of the song
+         * @return True if the song was found, otherwise false
+         */
+        bool search(std::string_view song, std::string_view artist) const;
+
+        /**
+         * @brief Search for many songs at once. The probes walk down the tree together a group at a time, so the cache
+         * misses of one probe overlap with the work of the others, and the title prefixes of a group are compared
+         * with SIMD instructions when the build targets AVX2 or SSE4.2
+         * @param keys The (song, artist) pairs to search for
+         * @return One flag per key, true if that song was found
+         */
+        std::vector<bool> searchMany(const std::vector<SongKey>& keys) const;
+
+        /**
+         * @brief Get the number of songs that sort before a (song, artist) pair, in O(log n)
+         * @param song The name of the song
+         * @param artist The name of the artist
+         * @return The 0 based position the pair has, or would have, in sorted order
+         */
+        size_t rankOf(std::string_view song, std::string_view artist) const;
+
+        /**
+         * @brief Get the song at a position in sorted order in O(1)
+         * @param k The 0 based position of the song
+         * @return Key viewing the song and artist stored in the snapshot, valid while the snapshot is alive
+         * @throw std::out_of_range if k is not less than getNumberOfSongs()
+         */
+        SongKey at(size_t k) const;
+
+        const_iterator begin() const { return songs_.begin(); }
+        const_iterator end() const { return songs_.end(); }
+
+    private:
+        /**
+         * @brief One node of the implicit search tree
+         */
+        struct Slot {
+            uint64_t prefix_; /** 8 bytes of the song title from offset_ on, big endian so integer order is title order */
+            uint32_t offset_; /** Length of the title prefix shared by every song a search can be looking for when it gets here */
+            uint32_t rank_; /** Position of the song in songs_ */
+        };
+
+        static constexpr size_t kSlotsPerLine = 4; /** Slots in one 64 byte cache line */
+        static constexpr size_t kProbeGroupSize = 8; /** Probes searchMany walks down the tree together */
+
+        /**
+         * @brief Four slots aligned to a cache line, slots 4i to 4i + 3 of the tree live in line i
+         */
+        struct alignas(64) Line {
+            Slot slots_[kSlotsPerLine];
+        };
+
+        /**
+         * @brief Pack part of a title into an integer that orders the same way as titles that agree before offset
+         * @param song The title
+         * @param offset Where the packed bytes start
+         * @return 8 bytes of the title from offset on, most significant first and padded with zeros
+         */
+        static uint64_t prefixOf(std::string_view song, size_t offset);
+
+        /**
+         * @brief Compare the title prefixes of a group of probes with the prefixes of the slots they are at
+         * @param slot_prefixes The prefix of the slot each probe is at
+         * @param key_prefixes The prefix of each probe's title, taken at the offset of its slot
+         * @param before Bit i is set if slot i orders before probe i on the prefix alone
+         * @param tied Bit i is set if the prefixes of slot i and probe i are equal and the full keys must decide
+         */
+        static void comparePrefixes(const uint64_t* slot_prefixes, const uint64_t* key_prefixes, unsigned& before, unsigned& tied);
+
+        /**
+         * @brief Give the slots of a subtree their songs in sorted order
+         * @param k The slot at the root of the subtree
+         * @param next_rank Position in songs_ of the next song to place, moved past every song placed
+         */
+        void fillSlots(size_t k, size_t& next_rank);
+
+        /**
+         * @brief Set the offset and prefix of every slot in a subtree, once every slot has its song
+         * @param k The slot at the root of the subtree
+         * @param low Title of the closest ancestor the subtree is to the right of, empty if there is none
+         * @param high Title of the closest ancestor the subtree is to the left of, empty if there is none
+         */
+        void fillPrefixes(size_t k, std::string_view low, std::string_view high);
+
+        /**
+         * @brief Get a slot of the implicit tree
+         * @param k The 1 based slot number
+         * @return The slot
+         */
+        const Slot& slot(size_t k) const { return lines_[k / kSlotsPerLine].slots_[k % kSlotsPerLine]; }
+        Slot& slot(size_t k) { return lines_[k / kSlotsPerLine].slots_[k % kSlotsPerLine]; }
+
+        /**
+         * @brief Find the first song that does not sort before a key
+         * @param key The song and artist to look for
+         * @return Position of that song in songs_, getNumberOfSongs() if every song sorts before key
+         */
+        size_t lowerBound(const SongKey& key) const;
+
+        std::unique_ptr<StringPool> strings_; /** The names of every song, owned by the snapshot */
+        std::vector<SongKey> songs_; /** Every song in sorted order, viewing names in strings_ */
+        std::vector<Line> lines_; /** The slots of the search tree, slot 0 is unused */
+};
+
+#endif//FLAT_PLAYLIST_H_
@@ -0,0 +1,179 @@
+/**
+ * @file NodePool.hpp
+ * @brief Slab allocator that hands out tree nodes from large contiguous chunks instead of one heap allocation per node
+ * @version 0.1
+ * @date 2024-07-14
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+
+#ifndef NODE_POOL_H_
+#define NODE_POOL_H_
+
+#include <algorithm>
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <utility>
+#include <vector>
+
+/**
+ * @brief A pool of fixed size slots for objects of type T.
+ *
+ * Slots are carved out of chunks that double in size up to a cap, and destroyed objects go on a free list
+ * so their slot is reused by the next create. Objects never move, so raw pointers to them stay valid until
+ * they are destroyed. release() gives every chunk back at once without running any destructor, so it may only be
+ * called once every object is destroyed or when T is trivially destructible.
+ *
+ * Playlist shares one pool between a tree and its copies. clear() on a Playlist that is the only user of its pool
+ * calls release() without visiting the nodes, which is safe because SongNode owns nothing. While copies still
+ * share the pool, Playlist::releaseTree destroys only the nodes no other copy links to and leaves the rest.
+ */
+template <typename T>
+class NodePool {
+    public:
+        /**
+         * @brief Default constructor for NodePool, no memory is reserved until the first create
+         */
+        NodePool() : free_list_(nullptr), next_slot_(0), live_(0) {}
+
+        NodePool(const NodePool&) = delete;
+        NodePool& operator=(const NodePool&) = delete;
+
+        /**
+         * @brief Move constructor for NodePool, the objects keep their addresses
+         * @param other The NodePool to take the chunks from
+         */
+        NodePool(NodePool&& other) noexcept :
+            chunks_(std::move(other.chunks_)), chunk_sizes_(std::move(other.chunk_sizes_)),
+            free_list_(other.free_list_), next_slot_(other.next_slot_), live_(other.live_) {
+            other.chunks_.clear();
+            other.chunk_sizes_.clear();
+            other.free_list_ = nullptr;
+            other.next_slot_ = 0;
+            other.live_ = 0;
+        }
+
+        /**
+         * @brief Move assignment operator for NodePool
+         * @param other The NodePool to take the chunks from
+         * @return Reference to this NodePool
+         * @pre Every object in this pool has already been destroyed
+         */
+        NodePool& operator=(NodePool&& other) noexcept {
+            if (this != &other) {
+                NodePool moved(std::move(other));
+                swap(moved);
+            }
+            return *this;
+        }
+
+        /**
+         * @brief Construct a new object in a free slot
+         * @param args Arguments forwarded to the constructor of T
+         * @return Pointer to the new object, owned by the pool until destroy or release
+         */
+        template <typename... Args>
+        T* create(Args&&... args) {
+            Slot* slot = takeSlot();
+            T* object = new (slot->storage_) T(std::forward<Args>(args)...);
+            live_++;
+            return object;
+        }
+
+        /**
+         * @brief Destroy an object and put its slot on the free list
+         * @param object Pointer returned by create on this pool
+         */
+        void destroy(T* object) {
+            object->~T();
+            Slot* slot = reinterpret_cast<Slot*>(object);
+            slot->next_ = free_list_;
+            free_list_ = slot;
+            live_--;
+        }
+
+        /**
+         * @brief Give every chunk back to the heap in one go
+         * @pre The destructors of all objects still in the pool have been run
+         */
+        void release() {
+            chunks_.clear();
+            chunk_sizes_.clear();
+            free_list_ = nullptr;
+            next_slot_ = 0;
+            live_ = 0;
+        }
+
+        /**
+         * @brief Get the number of objects created and not yet destroyed
+         * @return Number of live objects
+         */
+        size_t size() const {
+            return live_;
+        }
+
+        /**
+         * @brief Get the number of bytes reserved by the chunks of this pool
+         * @return Bytes held by the pool, including free slots
+         */
+        size_t capacityBytes() const {
+            size_t slots = 0;
+            for (size_t chunk_size : chunk_sizes_) {
+                slots += chunk_size;
+            }
+            return slots * sizeof(Slot);
+        }
+
+        /**
+         * @brief Exchange the chunks of two pools
+         * @param other The pool to swap with
+         */
+        void swap(NodePool& other) noexcept {
+            chunks_.swap(other.chunks_);
+            chunk_sizes_.swap(other.chunk_sizes_);
+            std::swap(free_list_, other.free_list_);
+            std::swap(next_slot_, other.next_slot_);
+            std::swap(live_, other.live_);
+        }
+
+    private:
+        /**
+         * @brief Storage for one object, reused as a free list link while the slot is empty
+         */
+        union Slot {
+            Slot* next_;
+            alignas(T) unsigned char storage_[sizeof(T)];
+        };
+
+        static constexpr size_t kFirstChunkSize = 64; /** Number of slots in the first chunk */
+        static constexpr size_t kMaxChunkSize = 65536; /** Chunks stop doubling once they hold this many slots */
+
+        /**
+         * @brief Pop a slot off the free list or bump allocate one from the newest chunk
+         * @return A slot with no object in it
+         */
+        Slot* takeSlot() {
+            if (free_list_ != nullptr) {
+                Slot* slot = free_list_;
+                free_list_ = slot->next_;
+                return slot;
+            }
+            if (chunks_.empty() || next_slot_ == chunk_sizes_.back()) {
+                size_t chunk_size = chunks_.empty() ? kFirstChunkSize : std::min(chunk_sizes_.back() * 2, kMaxChunkSize);
+                chunks_.emplace_back(new Slot[chunk_size]);
+                chunk_sizes_.push_back(chunk_size);
+                next_slot_ = 0;
+            }
+            return &chunks_.back()[next_slot_++];
+        }
+
+        std::vector<std::unique_ptr<Slot[]>> chunks_; /** Chunks of slots, oldest first */
+        std::vector<size_t> chunk_sizes_; /** Number of slots in each chunk */
+        Slot* free_list_; /** Slots whose object was destroyed, ready for reuse */
+        size_t next_slot_; /** Next never used slot in the newest chunk */
+        size_t live_; /** Number of objects currently constructed in the pool */
+};
+
+#endif//NODE_POOL_H_
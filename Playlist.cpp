@@ -10,62 +10,129 @@
  */
 #include "Playlist.hpp"
 
+#include <algorithm>
+#include <functional>
+#include <future>
+#include <queue>
+#include <stdexcept>
+#include <type_traits>
+
+//clear() hands whole chunks back to the node pool without visiting the nodes, which is only safe while they own nothing
+static_assert(std::is_trivially_destructible<SongNode>::value, "SongNode must not own memory outside the pools");
+
+namespace {
+
+/**
+ * @brief Copy the names and count of a node into an entry that no longer depends on the Playlist
+ */
+SongEntry entryOf(const SongNode& song){
+    return SongEntry{std::string(song.song()), std::string(song.artist()), song.count_};
+}
+
+}
+
 //default constructor  WORKS
 Playlist::Playlist(){
     root_ptr_ = nullptr;
 }
 //WORKS copy constructor
-Playlist::Playlist(const Playlist& other){
-    root_ptr_ = copyTree(other.root_ptr_);
-}
-//WORKS private 
-std::shared_ptr<SongNode> Playlist::copyTree(const std::shared_ptr<SongNode> old_tree_root_ptr)const{
-    std::shared_ptr<SongNode> new_tree_ptr;
-    //if the node we are copyingh is not null ptr 
-    if(old_tree_root_ptr != nullptr){
-        new_tree_ptr = std::make_shared<SongNode>(old_tree_root_ptr->song_ , old_tree_root_ptr -> artist_);
-        //copy the left and right subtree
-        new_tree_ptr ->left_ = copyTree(old_tree_root_ptr -> left_);
-        new_tree_ptr -> right_ = copyTree(old_tree_root_ptr -> right_);
+Playlist::Playlist(const Playlist& other) : pool_(other.pool_), strings_(other.strings_){
+    //share the whole tree, nodes only get copied when one of the playlists changes them
+    root_ptr_ = other.root_ptr_;
+    if(root_ptr_ != nullptr){
+        root_ptr_ -> refs_++;
+    }
+    if(other.artist_index_ != nullptr){
+        artist_index_ = std::make_unique<Playlist>(*other.artist_index_);
     }
-    return new_tree_ptr;
 }
 //WORRKS move constructor
-Playlist::Playlist(Playlist&& other){
+Playlist::Playlist(Playlist&& other) : pool_(std::move(other.pool_)), strings_(std::move(other.strings_)), artist_index_(std::move(other.artist_index_)){
+    //the nodes stay where they are, only the pool that owns them changes hands
     root_ptr_ = other.root_ptr_;
-    other.root_ptr_.reset();
+    other.root_ptr_ = nullptr;
 }
 
 //copy assignment operator WORKS 
 Playlist& Playlist::operator=(const Playlist& other){
-    root_ptr_ = copyTree(other.root_ptr_);
+    if(this != &other){
+        clear();
+        pool_ = other.pool_;
+        strings_ = other.strings_;
+        root_ptr_ = other.root_ptr_;
+        if(root_ptr_ != nullptr){
+            root_ptr_ -> refs_++;
+        }
+        artist_index_.reset();
+        if(other.artist_index_ != nullptr){
+            artist_index_ = std::make_unique<Playlist>(*other.artist_index_);
+        }
+    }
     return *this;
 }
 
 //move assignment operator WORKS
 Playlist& Playlist::operator=(Playlist&& other){
-    root_ptr_ = other.root_ptr_;
-    other.root_ptr_.reset();
+    if(this != &other){
+        clear();
+        pool_ = std::move(other.pool_);
+        strings_ = std::move(other.strings_);
+        root_ptr_ = other.root_ptr_;
+        other.root_ptr_ = nullptr;
+        artist_index_ = std::move(other.artist_index_);
+    }
     return *this;
 }
 
 //destructor works
 Playlist::~Playlist(){
-    destroyTree(root_ptr_);
-    root_ptr_.reset();
+    clear();
 }
 //works (private)
-void Playlist::destroyTree(std::shared_ptr<SongNode> sub_song_ptr){
+void Playlist::releaseTree(SongNode* sub_song_ptr){
+    std::vector<SongNode*> pending;
     if(sub_song_ptr != nullptr){
-        destroyTree(sub_song_ptr->left_);
-        destroyTree(sub_song_ptr->right_);
-        sub_song_ptr.reset();
+        pending.push_back(sub_song_ptr);
+    }
+    while(!pending.empty()){
+        SongNode* node_ptr = pending.back();
+        pending.pop_back();
+        //a node another playlist still links to stays, and so does everything below it
+        if(--node_ptr -> refs_ > 0){
+            continue;
+        }
+        //grab the children before the node is gone
+        if(node_ptr->left_ != nullptr){
+            pending.push_back(node_ptr->left_);
+        }
+        if(node_ptr->right_ != nullptr){
+            pending.push_back(node_ptr->right_);
+        }
+        pool_->destroy(node_ptr);
     }
 }
 //works
 void Playlist::clear(){
-    destroyTree(root_ptr_);
-    root_ptr_.reset();
+    if(artist_index_ != nullptr){
+        artist_index_->clear();
+    }
+    //when no copy shares the pool every node in it belongs to this tree, and nodes own nothing, so the chunks can go
+    //back all at once without walking the tree. Otherwise drop this playlist's links and leave the pool to the copies
+    if(pool_ != nullptr && pool_.use_count() == 1){
+        pool_->release();
+    }
+    else{
+        releaseTree(root_ptr_);
+        pool_.reset();
+    }
+    root_ptr_ = nullptr;
+    //the names go the same way, copies still view them
+    if(strings_ != nullptr && strings_.use_count() == 1){
+        strings_->clear();
+    }
+    else{
+        strings_.reset();
+    }
 }
 //works
 bool Playlist::isEmpty() const{
@@ -73,62 +140,247 @@ bool Playlist::isEmpty() const{
 }
 
 //WORKS 
-bool Playlist::add(const std::string& song, const std::string& artist){
-    if(song != "" && artist != ""){
-        auto new_songnode_ptr = std::make_shared<SongNode>(song,artist);
-        root_ptr_ = placeNode(root_ptr_,new_songnode_ptr);
+bool Playlist::add(std::string_view song, std::string_view artist, size_t count){
+    PLAYLIST_TRACE(PlaylistStats::Scope scope(stats_, TracedOperation::Add, song.size() + artist.size()));
+    if(song != "" && artist != "" && count > 0){
+        SongNode* new_songnode_ptr = nullptr;
+        root_ptr_ = addValue(root_ptr_, getKey(song, artist), count, new_songnode_ptr);
+        //a repeat only bumped a count, the index only needs to hear about new songs
+        if(new_songnode_ptr != nullptr && artist_index_ != nullptr){
+            SongNode* index_node_ptr = artist_index_->pool().create(new_songnode_ptr -> artist(), new_songnode_ptr -> song());
+            artist_index_->root_ptr_ = artist_index_->placeNode(artist_index_->root_ptr_, index_node_ptr);
+        }
         return true;
         
     }
     return false;
 }
 
+SongNode* Playlist::addValue(SongNode* subtree_ptr, const SongKey& key, size_t count, SongNode*& created){
+    //the song is new, so this is the only place a node and its strings get allocated
+    if(subtree_ptr == nullptr){
+        created = createNode(key.song_, key.artist_);
+        created -> count_ = count;
+        created -> max_count_ = count;
+        return created;
+    }
+    PLAYLIST_TRACE(PlaylistStats::countStep());
+    //copy the node first if another playlist shares it
+    subtree_ptr = mutableNode(subtree_ptr);
+    int order = getKey(*subtree_ptr).compare(key);
+    if(order == 0){
+        subtree_ptr -> count_ += count;
+        updateMetadata(subtree_ptr);
+        return subtree_ptr;
+    }
+    if(order > 0){
+        subtree_ptr -> left_ = addValue(subtree_ptr -> left_, key, count, created);
+    }
+    else{
+        subtree_ptr -> right_ = addValue(subtree_ptr -> right_, key, count, created);
+    }
+    //rebalance also refreshes the size and max count on the way back up
+    return rebalance(subtree_ptr);
+}
+
+size_t Playlist::addBatch(const std::vector<std::pair<std::string, std::string>>& songs){
+    //sort keys viewing the pairs so no strings are copied until the nodes are made
+    std::vector<SongKey> sorted_songs;
+    sorted_songs.reserve(songs.size());
+    for(const auto& song : songs){
+        sorted_songs.emplace_back(song.first, song.second);
+    }
+    if(!std::is_sorted(sorted_songs.begin(), sorted_songs.end())){
+        std::sort(sorted_songs.begin(), sorted_songs.end());
+    }
+    CountedKeys batch = countRepeats(sorted_songs);
+    std::vector<SongNode*> created;
+
+    //a few songs into a big playlist are cheaper to add one at a time than to rebuild the whole tree
+    size_t existing_count = getNumberOfSongs();
+    if(batch.size() * (getHeight() + 1) < existing_count){
+        for(const auto& song : batch){
+            SongNode* new_songnode_ptr = nullptr;
+            root_ptr_ = addValue(root_ptr_, song.first, song.second, new_songnode_ptr);
+            if(new_songnode_ptr != nullptr){
+                created.push_back(new_songnode_ptr);
+            }
+        }
+    }
+    else{
+        //merge the nodes already in the tree with the batch and relink everything. Songs already in the tree keep their
+        //node and only have their count bumped, once any node shared with a copy of this playlist has been made private
+        root_ptr_ = unshareTree(root_ptr_);
+        std::vector<SongNode*> merged;
+        merged.reserve(existing_count + batch.size());
+        SongIterator existing = begin();
+        for(const auto& song : batch){
+            for(; existing != end() && getKey(*existing) < song.first; ++existing){
+                merged.push_back(const_cast<SongNode*>(&*existing));
+            }
+            if(existing != end() && getKey(*existing) == song.first){
+                SongNode* node_ptr = const_cast<SongNode*>(&*existing);
+                node_ptr -> count_ += song.second;
+                merged.push_back(node_ptr);
+                ++existing;
+                continue;
+            }
+            SongNode* new_songnode_ptr = createNode(song.first.song_, song.first.artist_);
+            new_songnode_ptr -> count_ = song.second;
+            merged.push_back(new_songnode_ptr);
+            created.push_back(new_songnode_ptr);
+        }
+        for(; existing != end(); ++existing){
+            merged.push_back(const_cast<SongNode*>(&*existing));
+        }
+        root_ptr_ = buildBalanced(merged, 0, merged.size());
+    }
+
+    if(artist_index_ != nullptr && !created.empty()){
+        artist_index_->linkBatch(artist_index_->createIndexNodes(std::vector<const SongNode*>(created.begin(), created.end())));
+    }
+    return created.size();
+}
+
+Playlist::CountedKeys Playlist::countRepeats(const std::vector<SongKey>& sorted_songs){
+    CountedKeys counted;
+    counted.reserve(sorted_songs.size());
+    for(const SongKey& song : sorted_songs){
+        //skip empty fields like add does, repeats sit next to each other once sorted
+        if(song.song_.empty() || song.artist_.empty()){
+            continue;
+        }
+        if(!counted.empty() && counted.back().first == song){
+            counted.back().second++;
+            continue;
+        }
+        counted.emplace_back(song, 1);
+    }
+    return counted;
+}
+
+void Playlist::linkBatch(const std::vector<SongNode*>& added){
+    //a few songs into a big playlist are cheaper to place one at a time than to rebuild the whole tree
+    size_t existing_count = getNumberOfSongs();
+    if(added.size() * (getHeight() + 1) < existing_count){
+        for(SongNode* new_songnode_ptr : added){
+            root_ptr_ = placeNode(root_ptr_, new_songnode_ptr);
+        }
+        return;
+    }
+
+    //merge the nodes already in the tree with the new ones and relink everything. The existing nodes are reused as they are
+    //once any node shared with a copy of this playlist has been replaced by a private copy
+    root_ptr_ = unshareTree(root_ptr_);
+    std::vector<SongNode*> existing;
+    existing.reserve(existing_count);
+    for(const SongNode& song : inorder()){
+        existing.push_back(const_cast<SongNode*>(&song));
+    }
+    std::vector<SongNode*> merged;
+    merged.reserve(existing.size() + added.size());
+    std::merge(existing.begin(), existing.end(), added.begin(), added.end(), std::back_inserter(merged),
+        [this](const SongNode* a, const SongNode* b){ return getKey(*a) < getKey(*b); });
+    root_ptr_ = buildBalanced(merged, 0, merged.size());
+}
+
+Playlist Playlist::fromSorted(const std::vector<std::pair<std::string, std::string>>& songs){
+    std::vector<SongKey> sorted_songs;
+    sorted_songs.reserve(songs.size());
+    for(size_t i = 0; i < songs.size(); i++){
+        sorted_songs.emplace_back(songs[i].first, songs[i].second);
+        if(i > 0 && sorted_songs[i] < sorted_songs[i - 1]){
+            throw std::invalid_argument("Playlist::fromSorted: songs are not sorted at position " + std::to_string(i));
+        }
+    }
+    Playlist playlist;
+    std::vector<SongNode*> nodes = playlist.createBatchNodes(countRepeats(sorted_songs));
+    playlist.root_ptr_ = playlist.buildBalanced(nodes, 0, nodes.size());
+    return playlist;
+}
+
+std::vector<SongNode*> Playlist::createBatchNodes(const CountedKeys& songs){
+    std::vector<SongNode*> nodes;
+    nodes.reserve(songs.size());
+    for(const auto& song : songs){
+        //max_count_ is filled in by updateMetadata once the nodes are linked
+        nodes.push_back(createNode(song.first.song_, song.first.artist_));
+        nodes.back() -> count_ = song.second;
+    }
+    return nodes;
+}
+
+std::vector<SongNode*> Playlist::createIndexNodes(const std::vector<const SongNode*>& songs){
+    std::vector<SongNode*> nodes;
+    nodes.reserve(songs.size());
+    for(const SongNode* song : songs){
+        nodes.push_back(pool().create(song -> artist(), song -> song()));
+    }
+    std::sort(nodes.begin(), nodes.end(), [this](const SongNode* a, const SongNode* b){ return getKey(*a) < getKey(*b); });
+    return nodes;
+}
+
+SongNode* Playlist::buildBalanced(const std::vector<SongNode*>& nodes, size_t first, size_t last){
+    if(first == last){
+        return nullptr;
+    }
+    //the middle node is the root so both halves differ in size by at most one
+    size_t middle = first + (last - first) / 2;
+    SongNode* node_ptr = nodes[middle];
+    node_ptr -> left_ = buildBalanced(nodes, first, middle);
+    node_ptr -> right_ = buildBalanced(nodes, middle + 1, last);
+    updateMetadata(node_ptr);
+    return node_ptr;
+}
+
 //WORKS (private)
-std::shared_ptr<SongNode> Playlist::placeNode(std::shared_ptr<SongNode> subtree_ptr, std::shared_ptr<SongNode> new_songnode_ptr){
+SongNode* Playlist::placeNode(SongNode* subtree_ptr, SongNode* new_songnode_ptr){
     //if root == nullptr new_songnode_ptr becomes the root
     if(subtree_ptr == nullptr){
         return new_songnode_ptr; //base case
     }
-    //place new_songnode to the left if it is less than or equal to the root node
-    std::string song_and_artist_subtree = (subtree_ptr->song_) + (subtree_ptr->artist_);
-
-    std::string song_and_artist_songNode = (new_songnode_ptr->song_) + (new_songnode_ptr->artist_);
-    if( song_and_artist_subtree > song_and_artist_songNode ){
+    PLAYLIST_TRACE(PlaylistStats::countStep());
+    //copy the node first if another playlist shares it
+    subtree_ptr = mutableNode(subtree_ptr);
+    //place new_songnode to the left if it is less than the root node
+    if( getKey(*subtree_ptr) > getKey(*new_songnode_ptr) ){
         subtree_ptr->left_ = placeNode(subtree_ptr->left_, new_songnode_ptr);
     }
     //place song node to the right subtree if node is greater than root item 
     else{ 
         subtree_ptr->right_ = placeNode(subtree_ptr-> right_, new_songnode_ptr);
     }
-    return subtree_ptr;
+    //the new node made one side taller so fix the balance on the way back up
+    return rebalance(subtree_ptr);
 }
 //WORKS
 size_t Playlist::getHeight() const{
-    return getHeightHelper(root_ptr_);
-}
-//private WORKS
-size_t Playlist::getHeightHelper(std::shared_ptr<SongNode> sub_song_ptr) const{
-    //base cases
-    if(sub_song_ptr == nullptr){
-        return 0;
-    }    
-    return 1 + std::max(getHeightHelper(sub_song_ptr->left_) , getHeightHelper(sub_song_ptr->right_) );
+    return nodeHeight(root_ptr_);
 }
 // WORKS
 size_t Playlist::getNumberOfSongs()const{
-    size_t the_songs = getNumberOfSongsHelper(root_ptr_);
-    return the_songs;
+    return nodeSize(root_ptr_);
 }
-// private WORKS
-size_t Playlist::getNumberOfSongsHelper( std::shared_ptr<SongNode> subtree_ptr) const{
-    //base
-    if(subtree_ptr == nullptr){
-        return 0;
-    }
-    return 1 + getNumberOfSongsHelper(subtree_ptr -> left_) + getNumberOfSongsHelper(subtree_ptr -> right_);
+
+PlaylistStatsSnapshot Playlist::stats() const{
+    PlaylistStatsSnapshot snapshot;
+    PLAYLIST_TRACE(stats_.fill(snapshot));
+    //the shape and memory fields cost nothing to keep, so they are filled in every build
+    snapshot.songs_ = getNumberOfSongs();
+    snapshot.height_ = getHeight();
+    snapshot.live_nodes_ = pool_ == nullptr ? 0 : pool_->size();
+    snapshot.node_bytes_ = pool_ == nullptr ? 0 : pool_->capacityBytes();
+    snapshot.string_bytes_ = strings_ == nullptr ? 0 : strings_->bytesUsed();
+    snapshot.index_bytes_ = artist_index_ == nullptr || artist_index_->pool_ == nullptr ? 0 : artist_index_->pool_->capacityBytes();
+    return snapshot;
+}
+
+void Playlist::resetStats(){
+    PLAYLIST_TRACE(stats_.reset());
 }
 
-bool Playlist::search(const std::string& name, const std::string& artist)const{
+bool Playlist::search(std::string_view name, std::string_view artist)const{
+    PLAYLIST_TRACE(PlaylistStats::Scope scope(stats_, TracedOperation::Search, name.size() + artist.size()));
 
     if(searchHelper(root_ptr_, getKey(name, artist))){
         return true;
@@ -137,141 +389,650 @@ bool Playlist::search(const std::string& name, const std::string& artist)const{
     return false; 
 }
 
-bool Playlist::searchHelper( std::shared_ptr<SongNode> sub_song_ptr, const std::string key  )const{
+std::vector<bool> Playlist::searchMany(const std::vector<SongKey>& keys) const{
+    std::vector<bool> found(keys.size());
+    for(size_t first = 0; first < keys.size(); first += kProbeGroupSize){
+        size_t count = std::min(kProbeGroupSize, keys.size() - first);
+        const SongNode* node_ptrs[kProbeGroupSize];
+        for(size_t i = 0; i < count; i++){
+            node_ptrs[i] = root_ptr_;
+        }
+        //every probe takes one step per round, and the node it steps to is fetched while the other probes compare
+        bool walking = root_ptr_ != nullptr;
+        while(walking){
+            walking = false;
+            for(size_t i = 0; i < count; i++){
+                if(node_ptrs[i] == nullptr){
+                    continue;
+                }
+                int order = getKey(*node_ptrs[i]).compare(keys[first + i]);
+                if(order == 0){
+                    found[first + i] = true;
+                    node_ptrs[i] = nullptr;
+                    continue;
+                }
+                node_ptrs[i] = order < 0 ? node_ptrs[i] -> right_ : node_ptrs[i] -> left_;
+                if(node_ptrs[i] != nullptr){
+                    __builtin_prefetch(node_ptrs[i]);
+                    walking = true;
+                }
+            }
+        }
+    }
+    return found;
+}
+
+bool Playlist::searchHelper(SongNode* sub_song_ptr, const SongKey& key) const{
     if( sub_song_ptr == nullptr){
         return false;
     }
+    PLAYLIST_TRACE(PlaylistStats::countStep());
 
-    else if( getKey(*sub_song_ptr) == key ){
+    int order = getKey(*sub_song_ptr).compare(key);
+    if( order == 0 ){
         return true;
     }
 
-    else if( getKey(*sub_song_ptr) < key ){
+    else if( order < 0 ){
         return searchHelper( sub_song_ptr -> right_ , key);
     }
     return searchHelper( sub_song_ptr -> left_ , key);
 }
 
 
-bool Playlist::remove(const std::string& song, const std::string& artist) {
+bool Playlist::remove(std::string_view song, std::string_view artist) {
+    PLAYLIST_TRACE(PlaylistStats::Scope scope(stats_, TracedOperation::Remove, song.size() + artist.size()));
+    //removeValue copies shared nodes on the way down, so make sure a miss does not copy a path for nothing. The lookup
+    //goes around search so a remove is not also traced as a search
+    if(pool_.use_count() > 1 && !searchHelper(root_ptr_, getKey(song, artist))){
+        return false;
+    }
     bool is_successful = false;
-    root_ptr_ = removeValue(root_ptr_, song, artist, is_successful);
+    root_ptr_ = removeValue(root_ptr_, getKey(song, artist), is_successful);
+    if(is_successful && artist_index_ != nullptr){
+        artist_index_->remove(artist, song);
+    }
     return is_successful;
 }
 
-std::shared_ptr<SongNode> Playlist::removeValue(std::shared_ptr<SongNode> sub_tree, const std::string& song, const std::string& artist, bool& success) {
+size_t Playlist::getCount(std::string_view song, std::string_view artist) const{
+    SongKey key = getKey(song, artist);
+    const SongNode* node_ptr = root_ptr_;
+    while(node_ptr != nullptr){
+        int order = getKey(*node_ptr).compare(key);
+        if(order == 0){
+            return node_ptr -> count_;
+        }
+        node_ptr = order < 0 ? node_ptr -> right_ : node_ptr -> left_;
+    }
+    return 0;
+}
+
+std::vector<SongEntry> Playlist::topSongs(size_t k) const{
+    //best first search. A subtree waits in the queue under the largest count in it, a song under its own count, so a song
+    //only comes out once nothing still queued can beat it and subtrees that hold no top song are never opened
+    struct Candidate{
+        size_t count_;
+        const SongNode* node_ptr_;
+        bool whole_subtree_;
+    };
+    auto is_lower = [](const Candidate& a, const Candidate& b){ return a.count_ < b.count_; };
+    std::priority_queue<Candidate, std::vector<Candidate>, decltype(is_lower)> candidates(is_lower);
+    if(root_ptr_ != nullptr){
+        candidates.push({root_ptr_ -> max_count_, root_ptr_, true});
+    }
+    std::vector<SongEntry> top;
+    top.reserve(std::min(k, getNumberOfSongs()));
+    while(top.size() < k && !candidates.empty()){
+        Candidate best = candidates.top();
+        candidates.pop();
+        if(!best.whole_subtree_){
+            top.push_back(entryOf(*best.node_ptr_));
+            continue;
+        }
+        candidates.push({best.node_ptr_ -> count_, best.node_ptr_, false});
+        for(const SongNode* child_ptr : {best.node_ptr_ -> left_, best.node_ptr_ -> right_}){
+            if(child_ptr != nullptr){
+                candidates.push({child_ptr -> max_count_, child_ptr, true});
+            }
+        }
+    }
+    return top;
+}
+
+SongNode* Playlist::removeValue(SongNode* sub_tree, const SongKey& key, bool& success) {
     // If subtree is empty, set success flag to false and return nullptr
     if (sub_tree == nullptr) {
         success = false;
         return sub_tree;
     }
+    PLAYLIST_TRACE(PlaylistStats::countStep());
+    // Copy the node first if another playlist shares it
+    sub_tree = mutableNode(sub_tree);
+    int order = getKey(*sub_tree).compare(key);
     // If the current node matches the song and artist, remove the node and set success flag to true
-    if (getKey(*sub_tree) == getKey(song,artist)) {
+    if (order == 0) {
         sub_tree = removeNode(sub_tree);
         success = true;
         return sub_tree;
     }
     // Recursively search in the left subtree if the current node key is greater than the target song and artist
-    if (getKey(*sub_tree) > getKey(song,artist)) {
-        sub_tree -> left_ = removeValue(sub_tree -> left_, song, artist, success);
+    if (order > 0) {
+        sub_tree -> left_ = removeValue(sub_tree -> left_, key, success);
     }
     // Recursively search in the right subtree if the current node key is less than the target song and artist
     else {
-        sub_tree -> right_ = removeValue(sub_tree -> right_, song, artist, success);
+        sub_tree -> right_ = removeValue(sub_tree -> right_, key, success);
     }
-    return sub_tree;
+    return rebalance(sub_tree);
 }
 
 
-std::shared_ptr<SongNode> Playlist::removeNode(std::shared_ptr<SongNode> node_ptr) {
-    // If the node is a leaf node, reset it and return nullptr
-    if (node_ptr->isLeaf()) {
-        node_ptr.reset();
-        return node_ptr;
-    }
-    // If the left child is nullptr, return the right child
-    else if (node_ptr -> left_ == nullptr) {
-        return node_ptr -> right_;
+SongNode* Playlist::removeNode(SongNode* node_ptr) {
+    SongNode* replacement = nullptr;
+    // The node is not shared, so its links simply move to the replacement and the node goes back to the pool
+    // If the left child is nullptr, the right child takes its place (nullptr for a leaf)
+    if (node_ptr -> left_ == nullptr) {
+        replacement = node_ptr -> right_;
     }
-    // If the right child is nullptr, return the left child
+    // If the right child is nullptr, the left child takes its place
     else if (node_ptr -> right_ == nullptr) {
-        return node_ptr -> left_;
-    }
-    // If there are two children, find the leftmost node in the right subtree and replace the current node
-    std::string inorder_song;
-    std::string inorder_artist;
-    node_ptr -> right_ = removeLeftmostNode(node_ptr -> right_, inorder_song, inorder_artist);
-    node_ptr -> song_ = inorder_song;
-    node_ptr -> artist_ = inorder_artist;
-    return node_ptr;
+        replacement = node_ptr -> left_;
+    }
+    // If there are two children, unlink the leftmost node in the right subtree and move it into the place of the current node
+    else {
+        SongNode* remaining_right = removeLeftmostNode(node_ptr -> right_, replacement);
+        replacement -> left_ = node_ptr -> left_;
+        replacement -> right_ = remaining_right;
+        replacement = rebalance(replacement);
+    }
+    pool_->destroy(node_ptr);
+    PLAYLIST_TRACE(stats_.countFree());
+    return replacement;
 }
 
-// TODO: Remove this comment. DO NOT MODIFY THIS FUNCTION
-std::shared_ptr<SongNode> Playlist::removeLeftmostNode(std::shared_ptr<SongNode> node_ptr, std::string& inorder_song, std::string& inorder_artist) {
-    // If the left child is nullptr, store the song and artist, remove the current node
+SongNode* Playlist::removeLeftmostNode(SongNode* node_ptr, SongNode*& leftmost) {
+    PLAYLIST_TRACE(PlaylistStats::countVisit());
+    // Copy the node first if another playlist shares it, the leftmost node gets relinked so it must be private too
+    node_ptr = mutableNode(node_ptr);
+    // If the left child is nullptr, this is the leftmost node and its right subtree takes its place
     if (node_ptr -> left_ == nullptr) {
-        inorder_song = node_ptr -> song_;
-        inorder_artist = node_ptr -> artist_;
-        return removeNode(node_ptr);
+        leftmost = node_ptr;
+        return node_ptr -> right_;
     }
     // Recursively search for the leftmost node
-    node_ptr -> left_ = removeLeftmostNode(node_ptr -> left_, inorder_song, inorder_artist);
-    return node_ptr;
+    node_ptr -> left_ = removeLeftmostNode(node_ptr -> left_, leftmost);
+    return rebalance(node_ptr);
 }
 
-// TODO: Remove this comment. DO NOT MODIFY THIS FUNCTION
-std::vector<SongNode> Playlist::inorderTraverse() const{
-    std::vector<SongNode> result;
-    inorderHelper(root_ptr_,result);
-    return result;
+SongIterator Playlist::begin() const{
+    return SongIterator(root_ptr_, TraversalOrder::Inorder);
 }
 
-// TODO: Remove this comment. DO NOT MODIFY THIS FUNCTION
-void Playlist::inorderHelper(std::shared_ptr<SongNode> node_ptr, std::vector<SongNode>& result) const {
-    // If node is not nullptr, add the node in the result vector following inorder traversal
-    if (node_ptr != nullptr) {
-        inorderHelper(node_ptr -> left_, result);
-        result.push_back(*node_ptr);
-        inorderHelper(node_ptr -> right_, result);
+SongIterator Playlist::end() const{
+    return SongIterator();
+}
+
+SongRange Playlist::preorder() const{
+    return SongRange(SongIterator(root_ptr_, TraversalOrder::Preorder), end());
+}
+
+SongRange Playlist::inorder() const{
+    return SongRange(begin(), end());
+}
+
+SongRange Playlist::postorder() const{
+    return SongRange(SongIterator(root_ptr_, TraversalOrder::Postorder), end());
+}
+
+std::vector<SongEntry> Playlist::inorderTraverse() const{
+    std::vector<SongEntry> songs;
+    songs.reserve(getNumberOfSongs());
+    for(const SongNode& song : inorder()){
+        songs.push_back(entryOf(song));
     }
+    return songs;
 }
 
-std::vector<SongNode> Playlist::preorderTraverse() const{
-    std::vector<SongNode> result;
-    preorderHelper(root_ptr_, result);
-    return result;
+std::vector<SongEntry> Playlist::preorderTraverse() const{
+    std::vector<SongEntry> songs;
+    songs.reserve(getNumberOfSongs());
+    for(const SongNode& song : preorder()){
+        songs.push_back(entryOf(song));
+    }
+    return songs;
+}
+
+std::vector<SongEntry> Playlist::postorderTraverse() const{
+    std::vector<SongEntry> songs;
+    songs.reserve(getNumberOfSongs());
+    for(const SongNode& song : postorder()){
+        songs.push_back(entryOf(song));
+    }
+    return songs;
+}
+
+size_t Playlist::rankOf(std::string_view song, std::string_view artist) const{
+    SongKey key = getKey(song, artist);
+    size_t rank = 0;
+    SongNode* node_ptr = root_ptr_;
+    while(node_ptr != nullptr){
+        //when the song is to the right, the node and its whole left subtree come before it
+        if(getKey(*node_ptr) < key){
+            rank += nodeSize(node_ptr -> left_) + 1;
+            node_ptr = node_ptr -> right_;
+        }
+        else{
+            node_ptr = node_ptr -> left_;
+        }
+    }
+    return rank;
+}
+
+const SongNode& Playlist::at(size_t k) const{
+    if(k >= getNumberOfSongs()){
+        throw std::out_of_range("Playlist::at: position " + std::to_string(k) + " is past the last song");
+    }
+    SongNode* node_ptr = root_ptr_;
+    //the left subtree holds the k smallest songs of the subtree, so compare k with its size to pick a side
+    while(k != nodeSize(node_ptr -> left_)){
+        if(k < nodeSize(node_ptr -> left_)){
+            node_ptr = node_ptr -> left_;
+        }
+        else{
+            k -= nodeSize(node_ptr -> left_) + 1;
+            node_ptr = node_ptr -> right_;
+        }
+    }
+    return *node_ptr;
+}
+
+SongRange Playlist::range(size_t offset, size_t count) const{
+    //clamp so offset + count cannot wrap around
+    size_t last = offset + std::min(count, getNumberOfSongs() - std::min(offset, getNumberOfSongs()));
+    return SongRange(inorderAt(offset), inorderAt(last));
 }
 
-void Playlist::preorderHelper(std::shared_ptr<SongNode> node_ptr, std::vector<SongNode>& result) const{
-    //if node is not nullptr, add the node in the result vector following preorder traversal 
-    if(node_ptr != nullptr){
-        result.push_back(*node_ptr);
-        preorderHelper(node_ptr -> left_, result);
-        preorderHelper(node_ptr -> right_, result);
+void Playlist::enableArtistIndex(){
+    if(artist_index_ != nullptr){
+        return;
     }
+    std::vector<const SongNode*> songs;
+    songs.reserve(getNumberOfSongs());
+    for(const SongNode& song : inorder()){
+        songs.push_back(&song);
+    }
+    //repeated songs stay next to each other once sorted, so building straight from the sorted nodes keeps them all
+    artist_index_ = std::make_unique<Playlist>();
+    std::vector<SongNode*> nodes = artist_index_->createIndexNodes(songs);
+    artist_index_->root_ptr_ = artist_index_->buildBalanced(nodes, 0, nodes.size());
+}
+
+void Playlist::disableArtistIndex(){
+    artist_index_.reset();
+}
+
+bool Playlist::hasArtistIndex() const{
+    return artist_index_ != nullptr;
+}
+
+ArtistRange Playlist::findByArtist(std::string_view artist) const{
+    if(artist_index_ == nullptr){
+        throw std::logic_error("Playlist::findByArtist: the artist index is not enabled");
+    }
+    //in the index the artist is stored as the song, so the songs by an artist are the index entries with that exact title.
+    //Both ends are found by comparing against the artist itself, so no bound string has to be built
+    SongIterator first = artist_index_->inorderLowerBound([artist](const SongNode& node){
+        return node.song() < artist;
+    });
+    SongIterator last = artist_index_->inorderLowerBound([artist](const SongNode& node){
+        return node.song() <= artist;
+    });
+    return ArtistRange(SongRange(first, last));
+}
+
+Playlist Playlist::unionWith(const Playlist& other, size_t threads, size_t min_songs_per_thread) const{
+    return combine(other, SetOperation::Union, threads, min_songs_per_thread);
+}
+
+Playlist Playlist::intersect(const Playlist& other, size_t threads, size_t min_songs_per_thread) const{
+    return combine(other, SetOperation::Intersection, threads, min_songs_per_thread);
 }
 
-std::vector<SongNode> Playlist::postorderTraverse() const{
-    std::vector<SongNode> result;
-    postorderHelper(root_ptr_, result);
+Playlist Playlist::difference(const Playlist& other, size_t threads, size_t min_songs_per_thread) const{
+    return combine(other, SetOperation::Difference, threads, min_songs_per_thread);
+}
+
+Playlist Playlist::combine(const Playlist& other, SetOperation operation, size_t threads, size_t min_songs_per_thread) const{
+    //cut the larger playlist into runs of about equal size. The other playlist is cut before the same song each cut
+    //lands on, so equal songs never end up in two different runs
+    size_t total = getNumberOfSongs() + other.getNumberOfSongs();
+    size_t runs = std::max<size_t>(1, std::min(threads, total / std::max<size_t>(1, min_songs_per_thread)));
+    const Playlist& larger = getNumberOfSongs() >= other.getNumberOfSongs() ? *this : other;
+    std::vector<size_t> cuts = {0};
+    std::vector<size_t> other_cuts = {0};
+    for(size_t i = 1; i < runs; i++){
+        const SongNode& song = larger.at(larger.getNumberOfSongs() * i / runs);
+        cuts.push_back(rankOf(song.song(), song.artist()));
+        other_cuts.push_back(other.rankOf(song.song(), song.artist()));
+    }
+    cuts.push_back(getNumberOfSongs());
+    other_cuts.push_back(other.getNumberOfSongs());
+
+    //run 0 is merged on this thread while the rest go to their own threads, the walks only read the two trees
+    std::vector<CountedKeys> kept(cuts.size() - 1);
+    std::vector<std::future<void>> pending;
+    for(size_t i = kept.size(); i-- > 0;){
+        SongRange first = range(cuts[i], cuts[i + 1] - cuts[i]);
+        SongRange second = other.range(other_cuts[i], other_cuts[i + 1] - other_cuts[i]);
+        if(i == 0){
+            mergeRuns(first, second, operation, kept[i]);
+        }
+        else{
+            pending.push_back(std::async(std::launch::async, mergeRuns, first, second, operation, std::ref(kept[i])));
+        }
+    }
+    for(auto& run : pending){
+        run.get();
+    }
+
+    CountedKeys merged;
+    if(kept.size() == 1){
+        merged = std::move(kept[0]);
+    }
+    else{
+        size_t merged_size = 0;
+        for(const auto& run : kept){
+            merged_size += run.size();
+        }
+        merged.reserve(merged_size);
+        for(const auto& run : kept){
+            merged.insert(merged.end(), run.begin(), run.end());
+        }
+    }
+    Playlist result;
+    std::vector<SongNode*> nodes = result.createBatchNodes(merged);
+    result.root_ptr_ = result.buildBalanced(nodes, 0, nodes.size());
     return result;
 }
 
-void Playlist::postorderHelper(std::shared_ptr<SongNode> node_ptr, std::vector<SongNode>& result) const{
-    //if node is not nullptr, add the node in the result vector following preorder traversal 
-    if(node_ptr != nullptr){
-        postorderHelper(node_ptr -> left_, result);
-        postorderHelper(node_ptr -> right_, result);
-        result.push_back(*node_ptr);
+void Playlist::mergeRuns(SongRange first, SongRange second, SetOperation operation, CountedKeys& kept){
+    SongIterator a = first.begin();
+    SongIterator b = second.begin();
+    while(a != first.end() || b != second.end()){
+        int order = a == first.end() ? 1 : b == second.end() ? -1 : SongKey(a->song(), a->artist()).compare(SongKey(b->song(), b->artist()));
+        //the names stay valid because the nodes are still in the trees
+        SongKey key = order <= 0 ? SongKey(a->song(), a->artist()) : SongKey(b->song(), b->artist());
+        size_t first_count = order <= 0 ? a->count_ : 0;
+        size_t second_count = order >= 0 ? b->count_ : 0;
+        if(order <= 0){
+            ++a;
+        }
+        if(order >= 0){
+            ++b;
+        }
+        if(operation == SetOperation::Union){
+            kept.emplace_back(key, first_count + second_count);
+        }
+        else if(operation == SetOperation::Intersection && first_count > 0 && second_count > 0){
+            kept.emplace_back(key, std::min(first_count, second_count));
+        }
+        else if(operation == SetOperation::Difference && first_count > 0 && second_count == 0){
+            kept.emplace_back(key, first_count);
+        }
+    }
+}
+
+template <typename IsBefore>
+SongIterator Playlist::inorderLowerBound(IsBefore is_before) const{
+    std::vector<const SongNode*> ancestors;
+    SongNode* node_ptr = root_ptr_;
+    while(node_ptr != nullptr){
+        if(is_before(*node_ptr)){
+            node_ptr = node_ptr -> right_;
+        }
+        else{
+            //this node is a candidate, but there may be an earlier one in its left subtree
+            ancestors.push_back(node_ptr);
+            node_ptr = node_ptr -> left_;
+        }
     }
+    return SongIterator(std::move(ancestors), TraversalOrder::Inorder);
 }
 
-// TODO: Remove this comment. DO NOT MODIFY THIS FUNCTION
-std::string Playlist::getKey(const std::string& song, const std::string& artist) const {
-    return song+artist;
+SongRange Playlist::findPrefix(std::string_view prefix) const{
+    //titles starting with the prefix sit together in sorted order, after the titles that are smaller than the prefix
+    SongIterator first = inorderLowerBound([&prefix](const SongNode& node){
+        return node.song().compare(prefix) < 0;
+    });
+    //and before the titles whose first prefix.size() characters are greater than the prefix
+    SongIterator last = inorderLowerBound([&prefix](const SongNode& node){
+        return node.song().compare(0, prefix.size(), prefix) <= 0;
+    });
+    return SongRange(first, last);
+}
+
+SongRange Playlist::findRange(std::string_view lo, std::string_view hi) const{
+    if(hi <= lo){
+        return SongRange(end(), end());
+    }
+    SongIterator first = inorderLowerBound([&lo](const SongNode& node){
+        return node.song() < lo;
+    });
+    SongIterator last = inorderLowerBound([&hi](const SongNode& node){
+        return node.song() < hi;
+    });
+    return SongRange(first, last);
+}
+
+SongIterator Playlist::inorderAt(size_t k) const{
+    std::vector<const SongNode*> ancestors;
+    SongNode* node_ptr = k < getNumberOfSongs() ? root_ptr_ : nullptr;
+    while(node_ptr != nullptr){
+        size_t left_size = nodeSize(node_ptr -> left_);
+        //the same stack an inorder walk would have: every node we went left from is still waiting to be visited
+        if(k < left_size){
+            ancestors.push_back(node_ptr);
+            node_ptr = node_ptr -> left_;
+        }
+        else if(k == left_size){
+            ancestors.push_back(node_ptr);
+            break;
+        }
+        else{
+            k -= left_size + 1;
+            node_ptr = node_ptr -> right_;
+        }
+    }
+    return SongIterator(std::move(ancestors), TraversalOrder::Inorder);
+}
+
+SongIterator::SongIterator(const SongNode* root, TraversalOrder order) : order_(order){
+    if(order_ == TraversalOrder::Preorder){
+        //preorder starts at the root itself
+        if(root != nullptr){
+            stack_.push_back(root);
+        }
+    }
+    else{
+        descend(root);
+    }
+}
+
+void SongIterator::descend(const SongNode* node_ptr){
+    while(node_ptr != nullptr){
+        stack_.push_back(node_ptr);
+        //inorder stops at the leftmost node, postorder keeps going right when there is no left child until it reaches a leaf
+        if(node_ptr -> left_ != nullptr || order_ == TraversalOrder::Inorder){
+            node_ptr = node_ptr -> left_;
+        }
+        else{
+            node_ptr = node_ptr -> right_;
+        }
+    }
 }
 
-// TODO: Remove this comment. DO NOT MODIFY THIS FUNCTION
-std::string Playlist::getKey(const SongNode& song) const {
-    return song.song_+song.artist_;
-}
\ No newline at end of file
+SongIterator& SongIterator::operator++(){
+    const SongNode* visited = stack_.back();
+    stack_.pop_back();
+    if(order_ == TraversalOrder::Preorder){
+        //push right first so the left subtree comes out first
+        if(visited -> right_ != nullptr){
+            stack_.push_back(visited -> right_);
+        }
+        if(visited -> left_ != nullptr){
+            stack_.push_back(visited -> left_);
+        }
+    }
+    else if(order_ == TraversalOrder::Inorder){
+        //the left subtree and the node are done, the next song is the leftmost node of the right subtree
+        descend(visited -> right_);
+    }
+    else if(!stack_.empty()){
+        //coming up from the left child means the right subtree of the parent is next, otherwise the parent itself is
+        const SongNode* parent = stack_.back();
+        if(parent -> left_ == visited){
+            descend(parent -> right_);
+        }
+    }
+    return *this;
+}
+
+SongKey Playlist::getKey(std::string_view song, std::string_view artist) const {
+    return SongKey(song, artist);
+}
+
+SongKey Playlist::getKey(const SongNode& song) const {
+    return SongKey(song.song(), song.artist());
+}
+
+size_t Playlist::nodeHeight(SongNode* node_ptr) const {
+    return node_ptr == nullptr ? 0 : node_ptr -> height_;
+}
+
+size_t Playlist::nodeSize(SongNode* node_ptr) const {
+    return node_ptr == nullptr ? 0 : node_ptr -> size_;
+}
+
+size_t Playlist::nodeMaxCount(SongNode* node_ptr) const {
+    return node_ptr == nullptr ? 0 : node_ptr -> max_count_;
+}
+
+void Playlist::updateMetadata(SongNode* node_ptr) {
+    node_ptr -> height_ = static_cast<uint32_t>(1 + std::max(nodeHeight(node_ptr -> left_), nodeHeight(node_ptr -> right_)));
+    node_ptr -> size_ = 1 + nodeSize(node_ptr -> left_) + nodeSize(node_ptr -> right_);
+    node_ptr -> max_count_ = std::max({node_ptr -> count_, nodeMaxCount(node_ptr -> left_), nodeMaxCount(node_ptr -> right_)});
+}
+
+SongNode* Playlist::rotateLeft(SongNode* node_ptr) {
+    // The right child moves up and the old root becomes its left child
+    SongNode* new_root = mutableNode(node_ptr -> right_);
+    node_ptr -> right_ = new_root -> left_;
+    new_root -> left_ = node_ptr;
+    updateMetadata(node_ptr);
+    updateMetadata(new_root);
+    return new_root;
+}
+
+SongNode* Playlist::rotateRight(SongNode* node_ptr) {
+    // The left child moves up and the old root becomes its right child
+    SongNode* new_root = mutableNode(node_ptr -> left_);
+    node_ptr -> left_ = new_root -> right_;
+    new_root -> right_ = node_ptr;
+    updateMetadata(node_ptr);
+    updateMetadata(new_root);
+    return new_root;
+}
+
+SongNode* Playlist::rebalance(SongNode* node_ptr) {
+    if (node_ptr == nullptr) {
+        return node_ptr;
+    }
+    updateMetadata(node_ptr);
+    size_t left_height = nodeHeight(node_ptr -> left_);
+    size_t right_height = nodeHeight(node_ptr -> right_);
+    // Left side is too tall, rotate the left child first if it leans right (left-right case)
+    if (left_height > right_height + 1) {
+        if (nodeHeight(node_ptr -> left_ -> right_) > nodeHeight(node_ptr -> left_ -> left_)) {
+            node_ptr -> left_ = rotateLeft(mutableNode(node_ptr -> left_));
+        }
+        return rotateRight(node_ptr);
+    }
+    // Right side is too tall, rotate the right child first if it leans left (right-left case)
+    if (right_height > left_height + 1) {
+        if (nodeHeight(node_ptr -> right_ -> left_) > nodeHeight(node_ptr -> right_ -> right_)) {
+            node_ptr -> right_ = rotateRight(mutableNode(node_ptr -> right_));
+        }
+        return rotateLeft(node_ptr);
+    }
+    return node_ptr;
+}
+
+NodePool<SongNode>& Playlist::pool() {
+    if (pool_ == nullptr) {
+        pool_ = std::make_shared<NodePool<SongNode>>();
+    }
+    return *pool_;
+}
+
+StringPool& Playlist::strings() {
+    if (strings_ == nullptr) {
+        strings_ = std::make_shared<StringPool>();
+    }
+    return *strings_;
+}
+
+SongNode* Playlist::createNode(std::string_view song, std::string_view artist) {
+    PLAYLIST_TRACE(stats_.countAllocation());
+    if (SongNode::fitsInline(song, artist)) {
+        return pool().create(song, artist);
+    }
+    // Long names spill to the string pool. Titles rarely repeat so they are just copied in, artists repeat across many songs so they are interned
+    return pool().create(strings().store(song), strings().intern(artist));
+}
+
+SongNode* Playlist::mutableNode(SongNode* node_ptr) {
+    if (node_ptr == nullptr || node_ptr -> refs_ == 1) {
+        return node_ptr;
+    }
+    // Another playlist links to this node too. Give this playlist its own copy that links to the same children,
+    // and drop this playlist's link to the shared node. Short names are copied, spilled ones are shared as the copies share the string pool
+    SongNode* copy_ptr = pool().create(node_ptr -> song(), node_ptr -> artist());
+    PLAYLIST_TRACE(stats_.countAllocation());
+    copy_ptr -> left_ = node_ptr -> left_;
+    copy_ptr -> right_ = node_ptr -> right_;
+    copy_ptr -> height_ = node_ptr -> height_;
+    copy_ptr -> size_ = node_ptr -> size_;
+    copy_ptr -> count_ = node_ptr -> count_;
+    copy_ptr -> max_count_ = node_ptr -> max_count_;
+    if (copy_ptr -> left_ != nullptr) {
+        copy_ptr -> left_ -> refs_++;
+    }
+    if (copy_ptr -> right_ != nullptr) {
+        copy_ptr -> right_ -> refs_++;
+    }
+    node_ptr -> refs_--;
+    return copy_ptr;
+}
+
+SongNode* Playlist::unshareTree(SongNode* node_ptr) {
+    node_ptr = mutableNode(node_ptr);
+    // Every node on the stack is already private to this playlist, so its children can be copied and relinked in place
+    std::vector<SongNode*> pending;
+    if (node_ptr != nullptr) {
+        pending.push_back(node_ptr);
+    }
+    while (!pending.empty()) {
+        SongNode* parent = pending.back();
+        pending.pop_back();
+        parent -> left_ = mutableNode(parent -> left_);
+        parent -> right_ = mutableNode(parent -> right_);
+        if (parent -> left_ != nullptr) {
+            pending.push_back(parent -> left_);
+        }
+        if (parent -> right_ != nullptr) {
+            pending.push_back(parent -> right_);
+        }
+    }
+    return node_ptr;
+}
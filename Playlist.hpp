@@ -12,24 +12,121 @@
 #ifndef PLAYLIST_H_
 #define PLAYLIST_H_
 
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <iterator>
 #include <memory>
 #include <iostream>
 #include <string>
+#include <string_view>
+#include <utility>
 #include <vector>
 
+#include "NodePool.hpp"
+#include "PlaylistStats.hpp"
+#include "StringPool.hpp"
+#include "ThreadPool.hpp"
+
+/**
+ * @brief A (song, artist) pair used to order the Playlist tree.
+ * 
+ * The key only views the strings it was built from, so building and comparing keys never allocates.
+ * Keys compare by song first and then by artist, so ("ab", "c") and ("a", "bc") are different keys.
+ */
+struct SongKey {
+    /**
+     * @brief Constructor for a SongKey object.
+     * @param song The name of the song, must outlive the key.
+     * @param artist The name of the artist, must outlive the key.
+     */
+    SongKey(std::string_view song, std::string_view artist) : song_(song), artist_(artist) {}
+
+    /**
+     * @brief Three way comparison of two keys.
+     * @param other The key to compare with.
+     * @return Negative if this key orders before other, 0 if they are equal, positive otherwise.
+     */
+    int compare(const SongKey& other) const {
+        int song_order = song_.compare(other.song_);
+        return song_order != 0 ? song_order : artist_.compare(other.artist_);
+    }
+
+    bool operator==(const SongKey& other) const { return compare(other) == 0; }
+    bool operator!=(const SongKey& other) const { return compare(other) != 0; }
+    bool operator<(const SongKey& other) const { return compare(other) < 0; }
+    bool operator>(const SongKey& other) const { return compare(other) > 0; }
+
+    std::string_view song_; /** Name of the song */
+    std::string_view artist_; /** Artist for the corresponding song */
+};
+
 /**
  * @brief A struct representing a node in a binary tree storing songs and artists.
+ * 
+ * Short names are copied into the node itself, song then artist in one buffer behind a one byte length each, so a
+ * lookup compares keys without leaving the node. The links, the lengths and the names come first and the bookkeeping
+ * only updates touch comes last, and with the node aligned to 32 bytes it spans exactly two cache lines.
+ * 
+ * Names too long to fit together in the buffer spill: the buffer then holds views of the song and artist, which are
+ * stored in the StringPool of the Playlist that made the node, so such a node is only valid while that Playlist, or a
+ * copy sharing its storage, is alive. Keep a SongEntry, from topSongs or the *Traverse functions, to hold on to a song.
+ * 
+ * This breaks source compatibility with earlier versions: the song_ and artist_ members are gone, read the names with
+ * song() and artist() instead, and refs_ and height_ are now 32 bit.
  */
-struct SongNode {
+struct alignas(32) SongNode {
+    static constexpr size_t kInlineNameBytes = 46; /** Bytes of song and artist together that are stored in the node */
+
     /**
      * @brief Constructor for a SongNode object.
-     * @param song The name of the song.
-     * @param artist The name of the artist.
+     * @param song The name of the song, must outlive the node unless fitsInline(song, artist).
+     * @param artist The name of the artist, must outlive the node unless fitsInline(song, artist).
      */
      //this makes a node with no children just an empty left and right side
-    SongNode(const std::string& song, const std::string& artist) : 
-        song_(song), artist_(artist), left_(nullptr), right_(nullptr) {}
-    
+    SongNode(std::string_view song, std::string_view artist) : 
+        left_(nullptr), right_(nullptr), size_(1), count_(1), max_count_(1), refs_(1), height_(1) {
+        if (fitsInline(song, artist)) {
+            song_length_ = static_cast<uint8_t>(song.size());
+            artist_length_ = static_cast<uint8_t>(artist.size());
+            song.copy(names_, song.size());
+            artist.copy(names_ + song.size(), artist.size());
+        } else {
+            song_length_ = kSpilled;
+            artist_length_ = kSpilled;
+            std::string_view views[2] = {song, artist};
+            std::memcpy(names_, views, sizeof(views));
+        }
+    }
+
+    /**
+     * @brief Checks if a song and artist are short enough to be stored in the node
+     * @param song The name of the song
+     * @param artist The name of the artist
+     * @return True if both names fit in the buffer together, otherwise they have to be stored elsewhere
+     */
+    static bool fitsInline(std::string_view song, std::string_view artist) {
+        return song.size() + artist.size() <= kInlineNameBytes;
+    }
+
+    /**
+     * @brief Get the name of the song
+     * @return View of the name, valid while the node, or the string pool for a spilled name, is alive
+     */
+    std::string_view song() const {
+        return song_length_ != kSpilled ? std::string_view(names_, song_length_) : spilledName(0);
+    }
+
+    /**
+     * @brief Get the artist of the song
+     * @return View of the name, valid while the node, or the string pool for a spilled name, is alive
+     */
+    std::string_view artist() const {
+        return song_length_ != kSpilled ? std::string_view(names_ + song_length_, artist_length_) : spilledName(1);
+    }
+
     /**
      * @brief Checks if the node is a leaf node.
      * @return True if the node is a leaf, false otherwise.
@@ -39,14 +136,220 @@ struct SongNode {
         return (left_ == nullptr) && (right_ == nullptr);
     }
     
+    SongNode* left_; /** Pointer to the left sub tree of the Playlist, owned by the node pool of the Playlist */
+    SongNode* right_; /** Pointer to the right sub tree of the Playlist, owned by the node pool of the Playlist */
+    uint8_t song_length_; /** Bytes of the song at the start of names_, or kSpilled */
+    uint8_t artist_length_; /** Bytes of the artist right after the song in names_, or kSpilled */
+    char names_[kInlineNameBytes]; /** The song and then the artist, or views of both if they spilled */
+    size_t size_; /** Number of nodes in the subtree rooted at this node */
+    size_t count_; /** Number of times the song was added, a repeated add bumps this instead of making a new node */
+    size_t max_count_; /** Largest count_ in the subtree rooted at this node, used to find the most added songs */
+    uint32_t refs_; /** Number of links to this node from parent nodes or Playlist roots, more than 1 once a copy of the Playlist shares it */
+    uint32_t height_; /** Height of the subtree rooted at this node, used to keep the Playlist balanced */
+
+private:
+    static constexpr uint8_t kSpilled = 0xFF; /** Length marking names that did not fit, never a real length as it exceeds kInlineNameBytes */
+
+    /**
+     * @brief Read one of the views a spilled node keeps in names_
+     * @param which 0 for the song, 1 for the artist
+     * @return The view
+     */
+    std::string_view spilledName(size_t which) const {
+        std::string_view view;
+        std::memcpy(&view, names_ + which * sizeof(view), sizeof(view));
+        return view;
+    }
+};
+
+/**
+ * @brief A song copied out of a Playlist, owning its names so it stays valid after the Playlist is gone
+ */
+struct SongEntry {
     std::string song_; /** Name of the song */
     std::string artist_; /** Artist for the corresponding song */
-    std::shared_ptr<SongNode> left_; /** Pointer to the left sub tree of the Playlist */
-    std::shared_ptr<SongNode> right_; /** Pointer to the right sub tree of the Playlist */
+    size_t count_; /** Number of times the song was added */
+};
+
+/**
+ * @brief The order a SongIterator visits the nodes of a Playlist in
+ */
+enum class TraversalOrder {
+    Preorder, /** Node, then left subtree, then right subtree */
+    Inorder, /** Left subtree, then node, then right subtree, which is sorted by song and artist */
+    Postorder /** Left subtree, then right subtree, then node */
+};
+
+/**
+ * @brief Forward iterator that walks a Playlist lazily in one of the three traversal orders.
+ * 
+ * The iterator keeps a stack of at most getHeight() node pointers and hands out references to the nodes
+ * in the tree, so no SongNode is copied. Adding or removing songs invalidates every iterator of that Playlist.
+ */
+class SongIterator {
+    public:
+        using iterator_category = std::forward_iterator_tag;
+        using value_type = SongNode;
+        using difference_type = std::ptrdiff_t;
+        using pointer = const SongNode*;
+        using reference = const SongNode&;
+
+        /**
+         * @brief Constructor for the end iterator of any traversal
+         */
+        SongIterator() : order_(TraversalOrder::Inorder) {}
+
+        /**
+         * @brief Constructor for an iterator positioned at the first node of a traversal
+         * @param root The root of the tree to walk, nullptr gives the end iterator
+         * @param order The traversal order to walk the tree in
+         */
+        SongIterator(const SongNode* root, TraversalOrder order);
+
+        reference operator*() const { return *stack_.back(); }
+        pointer operator->() const { return stack_.back(); }
+
+        /**
+         * @brief Move to the next node of the traversal
+         * @return Reference to this iterator
+         */
+        SongIterator& operator++();
+
+        /**
+         * @brief Move to the next node of the traversal
+         * @return Copy of the iterator before it moved
+         */
+        SongIterator operator++(int) {
+            SongIterator before = *this;
+            ++(*this);
+            return before;
+        }
+
+        bool operator==(const SongIterator& other) const { return current() == other.current(); }
+        bool operator!=(const SongIterator& other) const { return current() != other.current(); }
+
+    private:
+        friend class Playlist;
+
+        /**
+         * @brief Constructor for an iterator resuming from a stack that Playlist already built
+         * @param stack The stack the iterator would have if it had walked to its current node, the current node on top
+         * @param order The traversal order the stack belongs to
+         */
+        SongIterator(std::vector<const SongNode*> stack, TraversalOrder order) : stack_(std::move(stack)), order_(order) {}
+
+        /**
+         * @brief Get the node the iterator is positioned at
+         * @return The current node, nullptr once the traversal is finished
+         */
+        const SongNode* current() const { return stack_.empty() ? nullptr : stack_.back(); }
+
+        /**
+         * @brief Push the path from node_ptr down to the first node of its subtree in the traversal order
+         * @param node_ptr Root of the subtree, ignored if nullptr
+         */
+        void descend(const SongNode* node_ptr);
+
+        std::vector<const SongNode*> stack_; /** Nodes still to visit or come back to, the current node is always on top */
+        TraversalOrder order_; /** The traversal order being walked */
+};
+
+/**
+ * @brief A begin and end SongIterator pair so a traversal can be used in a range-for loop
+ */
+class SongRange {
+    public:
+        /**
+         * @brief Constructor for a SongRange object
+         * @param first Iterator at the first node of the range
+         * @param last Iterator one past the last node of the range
+         */
+        SongRange(SongIterator first, SongIterator last) : first_(first), last_(last) {}
+
+        SongIterator begin() const { return first_; }
+        SongIterator end() const { return last_; }
+
+    private:
+        SongIterator first_; /** Iterator at the first node of the range */
+        SongIterator last_; /** Iterator one past the last node of the range */
+};
+
+/**
+ * @brief Forward iterator over the artist index of a Playlist.
+ * 
+ * The artist index stores each song with the artist as its song and the title as its artist so it sorts by artist first.
+ * This iterator swaps them back and hands out SongKey views of the entry.
+ */
+class ArtistIterator {
+    public:
+        using iterator_category = std::forward_iterator_tag;
+        using value_type = SongKey;
+        using difference_type = std::ptrdiff_t;
+        using pointer = void;
+        using reference = SongKey;
+
+        /**
+         * @brief Constructor for an ArtistIterator object
+         * @param position Iterator over the nodes of the artist index
+         */
+        explicit ArtistIterator(SongIterator position) : position_(position) {}
+
+        /**
+         * @brief Get the song the iterator is positioned at
+         * @return Key viewing the song and artist, valid until the Playlist is changed
+         */
+        SongKey operator*() const { return SongKey(position_->artist(), position_->song()); }
+
+        ArtistIterator& operator++() {
+            ++position_;
+            return *this;
+        }
+
+        ArtistIterator operator++(int) {
+            ArtistIterator before = *this;
+            ++position_;
+            return before;
+        }
+
+        bool operator==(const ArtistIterator& other) const { return position_ == other.position_; }
+        bool operator!=(const ArtistIterator& other) const { return position_ != other.position_; }
+
+    private:
+        SongIterator position_; /** Position in the artist index */
+};
+
+/**
+ * @brief A begin and end ArtistIterator pair so an artist lookup can be used in a range-for loop
+ */
+class ArtistRange {
+    public:
+        /**
+         * @brief Constructor for an ArtistRange object
+         * @param songs The range of nodes in the artist index to walk
+         */
+        explicit ArtistRange(SongRange songs) : first_(songs.begin()), last_(songs.end()) {}
+
+        ArtistIterator begin() const { return first_; }
+        ArtistIterator end() const { return last_; }
+
+    private:
+        ArtistIterator first_; /** Iterator at the first song of the range */
+        ArtistIterator last_; /** Iterator one past the last song of the range */
 };
 
 /**
  * @brief Class representing a playlist of songs
+ * 
+ * The songs are kept in an AVL tree so the height stays O(log n) no matter what order songs are added in.
+ * Nodes are allocated from a NodePool and linked with raw pointers, so walking the tree never touches a
+ * reference count and clearing it gives the memory back in whole chunks. Short names live in the nodes, long ones
+ * in a StringPool: each long artist name is stored once however many songs it has, and the bytes of a removed song
+ * are only reclaimed by clear().
+ * 
+ * Copies are persistent snapshots: copying a Playlist shares the whole tree and the pool in O(1), and a change
+ * to either Playlist copies only the O(log n) nodes on the path it modifies, so the other one never sees it.
+ * The link counts on shared nodes are not atomic, so a Playlist and its copies must not be changed from
+ * different threads at the same time.
  */
 class Playlist {
     public:
@@ -56,7 +359,7 @@ class Playlist {
         Playlist();
         
         /**
-         * @brief Copy constructor for Playlist
+         * @brief Copy constructor for Playlist, shares the tree of other in O(1)
          * @param other The Playlist object to be copied
          */
         Playlist(const Playlist& other);
@@ -73,7 +376,7 @@ class Playlist {
         ~Playlist();
         
         /**
-         * @brief Copy assignment operator for Playlist
+         * @brief Copy assignment operator for Playlist, shares the tree of other in O(1)
          * @param other The Playlist object to be assigned
          * @return Reference to the assigned Playlist object
          */
@@ -93,32 +396,80 @@ class Playlist {
         bool isEmpty() const;
         
         /**
-         * @brief Get the height of the Playlist
+         * @brief Get the height of the Playlist in O(1) from the metadata stored at the root
          * @return Height of the Playlist tree
          */
         size_t getHeight() const;
         
         /**
-         * @brief Get the number of songs in the Playlist
-         * @return Number of songs in the Playlist
+         * @brief Get the number of distinct songs in the Playlist in O(1) from the metadata stored at the root
+         * @return Number of songs in the Playlist, a song added several times counts once
          */
         size_t getNumberOfSongs() const;
+
+        /**
+         * @brief Take a snapshot of the counters and latency histograms of the Playlist. They are only recorded in builds
+         * with PLAYLIST_INSTRUMENTATION defined, other builds fill in just the shape and memory fields
+         * @return The snapshot, which can be formatted with toText or toJson
+         */
+        PlaylistStatsSnapshot stats() const;
+
+        /**
+         * @brief Set the counters and latency histograms back to zero, does nothing without PLAYLIST_INSTRUMENTATION
+         */
+        void resetStats();
         
         /**
-         * @brief Add a song to the Playlist if the given song and artist is not empty string
+         * @brief Add a song to the Playlist if the given song and artist is not empty string. A song that is already in
+         * the Playlist is not stored again, its count goes up in O(log n) without allocating
          * @param song The name of the song to be added
          * @param artist The name of the artist of the song
+         * @param count How many times to add the song
          * @return True if the song was successfully added, otherwise false
          */
-        bool add(const std::string& song, const std::string& artist);
+        bool add(std::string_view song, std::string_view artist, size_t count = 1);
         
         /**
-         * @brief Remove a song from the Playlist if the song exists in the Playlist
+         * @brief Add many songs at once. The batch is sorted and its repeats counted once, merged with the songs already in
+         * the Playlist and the tree is rebuilt perfectly balanced in O(n + m log m). Small batches into a large Playlist are
+         * placed one by one instead since that is cheaper than a rebuild. Every pair adds one to the count of its song
+         * @param songs The (song, artist) pairs to add, pairs with an empty song or artist are skipped like in add
+         * @return Number of songs that were not in the Playlist before
+         */
+        size_t addBatch(const std::vector<std::pair<std::string, std::string>>& songs);
+
+        /**
+         * @brief Build a perfectly balanced Playlist from songs that are already sorted, in O(n)
+         * @param songs The (song, artist) pairs sorted by song and then artist. A repeated pair adds to the count of its
+         * song and pairs with an empty song or artist are skipped
+         * @return The new Playlist
+         * @throw std::invalid_argument if songs is not sorted
+         */
+        static Playlist fromSorted(const std::vector<std::pair<std::string, std::string>>& songs);
+        
+        /**
+         * @brief Remove a song from the Playlist if the song exists in the Playlist, however many times it was added
          * @param song The name of the song to be removed
          * @param artist The name of the artist of the song
          * @return True if the song was successfully removed, otherwise false
          */
-        bool remove(const std::string& song, const std::string& artist);
+        bool remove(std::string_view song, std::string_view artist);
+
+        /**
+         * @brief Get the number of times a song was added in O(log n)
+         * @param song The name of the song
+         * @param artist The name of the artist of the song
+         * @return The count of the song, 0 if it is not in the Playlist
+         */
+        size_t getCount(std::string_view song, std::string_view artist) const;
+
+        /**
+         * @brief Get the most added songs, most added first. Each subtree is only opened once nothing found so far beats
+         * the largest count in it, so this costs O(k log n log k) however big the Playlist is
+         * @param k The most songs to return
+         * @return The k songs with the highest counts and their counts, songs with equal counts in no particular order
+         */
+        std::vector<SongEntry> topSongs(size_t k) const;
         
         /**
          * @brief Search for a song in the Playlist
@@ -126,146 +477,478 @@ class Playlist {
          * @param artist The name of the artist of the song
          * @return True if the song was found, otherwise false
          */
-        bool search(const std::string& name, const std::string& artist) const;
+        bool search(std::string_view name, std::string_view artist) const;
+
+        /**
+         * @brief Search for many songs at once. The probes walk down the tree together a group at a time and prefetch
+         * the next node of each probe, so the cache misses of one probe overlap with the compares of the others
+         * @param keys The (song, artist) pairs to search for
+         * @return One flag per key, true if that song was found
+         */
+        std::vector<bool> searchMany(const std::vector<SongKey>& keys) const;
         
         /**
          * @brief Clear the Playlist of all songs
          */
         void clear();
         
+        /**
+         * @brief Get an iterator at the first song in inorder, so a range-for over the Playlist visits songs sorted by song and artist
+         * @return Iterator at the first song, equal to end() if the Playlist is empty
+         */
+        SongIterator begin() const;
+
+        /**
+         * @brief Get the iterator one past the last song of any traversal
+         * @return The end iterator
+         */
+        SongIterator end() const;
+
+        /**
+         * @brief Lazily walk the Playlist in preorder without copying any nodes
+         * @return Range over the nodes in preorder traversal order
+         */
+        SongRange preorder() const;
+
+        /**
+         * @brief Lazily walk the Playlist in inorder without copying any nodes
+         * @return Range over the nodes in inorder traversal order
+         */
+        SongRange inorder() const;
+
+        /**
+         * @brief Lazily walk the Playlist in postorder without copying any nodes
+         * @return Range over the nodes in postorder traversal order
+         */
+        SongRange postorder() const;
+
         /**
          * @brief Perform a preorder traversal of the Playlist
-         * @return Vector containing the nodes in preorder traversal order
+         * @return Vector containing the songs in preorder traversal order
          */
-        std::vector<SongNode> preorderTraverse() const;
+        std::vector<SongEntry> preorderTraverse() const;
         
         /**
          * @brief Perform an inorder traversal of the Playlist
-         * @return Vector containing the nodes in inorder traversal order
+         * @return Vector containing the songs in inorder traversal order
          */
-        std::vector<SongNode> inorderTraverse() const;
+        std::vector<SongEntry> inorderTraverse() const;
         
         /**
          * @brief Perform a postorder traversal of the Playlist
-         * @return Vector containing the nodes in postorder traversal order
+         * @return Vector containing the songs in postorder traversal order
+         */
+        std::vector<SongEntry> postorderTraverse() const;
+
+        /**
+         * @brief Get the position a song has, or would have, in the sorted order of the Playlist in O(log n)
+         * @param song The name of the song
+         * @param artist The name of the artist of the song
+         * @return Number of songs that order before the given song and artist
+         */
+        size_t rankOf(std::string_view song, std::string_view artist) const;
+
+        /**
+         * @brief Get the song at a position in the sorted order of the Playlist in O(log n)
+         * @param k The 0 based position of the song
+         * @return Reference to the node at position k, valid until the Playlist is changed
+         * @throw std::out_of_range if k is not less than getNumberOfSongs()
+         */
+        const SongNode& at(size_t k) const;
+
+        /**
+         * @brief Lazily walk a page of songs in sorted order in O(log n + count)
+         * @param offset The 0 based position of the first song in the page
+         * @param count The most songs the page can hold
+         * @return Range over the songs at positions offset up to offset + count, cut short at the end of the Playlist
+         */
+        SongRange range(size_t offset, size_t count) const;
+
+        /**
+         * @brief Lazily walk every song whose title starts with a prefix, in sorted order. Only the O(log n) nodes on the
+         * way to the first and last match are visited before the matches themselves
+         * @param prefix The start of the song title, an empty prefix matches every song
+         * @return Range over the matching songs
          */
-        std::vector<SongNode> postorderTraverse() const;
+        SongRange findPrefix(std::string_view prefix) const;
+
+        /**
+         * @brief Lazily walk every song whose title is at least lo and less than hi, in sorted order, in O(log n + matches)
+         * @param lo The smallest title in the range
+         * @param hi The first title past the range
+         * @return Range over the matching songs, empty if hi is not greater than lo
+         */
+        SongRange findRange(std::string_view lo, std::string_view hi) const;
+
+        /**
+         * @brief Start keeping a secondary index of the songs ordered by artist and then song. Building it costs
+         * O(n log n) once, after that add, remove and clear keep it up to date. Does nothing if it is already enabled
+         */
+        void enableArtistIndex();
+
+        /**
+         * @brief Stop keeping the artist index and free its memory
+         */
+        void disableArtistIndex();
+
+        /**
+         * @brief Check if the artist index is being kept
+         * @return True if enableArtistIndex was called and the index was not disabled since
+         */
+        bool hasArtistIndex() const;
+
+        /**
+         * @brief Lazily walk every song by an artist, sorted by song, in O(log n + matches) using the artist index
+         * @param artist The name of the artist
+         * @return Range over the songs by the artist
+         * @throw std::logic_error if the artist index is not enabled
+         */
+        ArtistRange findByArtist(std::string_view artist) const;
+
+        static constexpr size_t kMinSongsPerThread = 1 << 16; /** Default smallest run a set operation hands to a thread of its own */
+
+        /**
+         * @brief Make a new Playlist holding every song that is in this Playlist or in other, in O(n + m). The two
+         * sorted trees are merged and the result is built balanced straight from the merged run. The count of a song
+         * in the result is its count in this Playlist plus its count in other. The result has no artist index
+         * @param other The Playlist to merge with
+         * @param threads Number of threads to merge with, large inputs are split into that many runs merged in parallel
+         * @param min_songs_per_thread Fewest songs of the two inputs together to give each run, fewer runs are used if needed
+         * @return The merged Playlist
+         */
+        Playlist unionWith(const Playlist& other, size_t threads = 1, size_t min_songs_per_thread = kMinSongsPerThread) const;
+
+        /**
+         * @brief Make a new Playlist holding every song that is in both this Playlist and other, in O(n + m)
+         * @param other The Playlist to intersect with
+         * @param threads Number of threads to merge with, large inputs are split into that many runs merged in parallel
+         * @param min_songs_per_thread Fewest songs of the two inputs together to give each run, fewer runs are used if needed
+         * @return The songs found in both with the smaller of their two counts, with no artist index
+         */
+        Playlist intersect(const Playlist& other, size_t threads = 1, size_t min_songs_per_thread = kMinSongsPerThread) const;
+
+        /**
+         * @brief Make a new Playlist holding every song of this Playlist that is not in other, in O(n + m)
+         * @param other The Playlist whose songs are left out
+         * @param threads Number of threads to merge with, large inputs are split into that many runs merged in parallel
+         * @param min_songs_per_thread Fewest songs of the two inputs together to give each run, fewer runs are used if needed
+         * @return The songs found only in this Playlist with their counts, with no artist index
+         */
+        Playlist difference(const Playlist& other, size_t threads = 1, size_t min_songs_per_thread = kMinSongsPerThread) const;
+
+        /**
+         * @brief Call a function on every song using the threads of a pool. The sorted songs are cut into a few runs per
+         * thread by position, found through the subtree sizes in O(log n) each, so every task walks its own part of the tree
+         * @param threads The pool to run on
+         * @param visit Called as visit(song) once per song, from several threads at the same time
+         */
+        template <typename Visit>
+        void forEachParallel(ThreadPool& threads, Visit visit) const;
+
+        /**
+         * @brief Fold every song into one result using the threads of a pool. Each run of songs is folded into its own
+         * partial result and the partial results are joined in sorted order, so an order sensitive fold such as
+         * collecting the songs that pass a filter gives the same answer as a single threaded walk
+         * @param threads The pool to run on
+         * @param identity Starting value of every partial result, and the result for an empty Playlist
+         * @param visit Called as visit(partial, song) for each song of a run in sorted order, from several threads at the same time
+         * @param combine Called as combine(left, right) to join the partial results of neighbouring runs
+         * @return The partial results of all runs joined from first to last
+         */
+        template <typename T, typename Visit, typename Combine>
+        T reduceParallel(ThreadPool& threads, T identity, Visit visit, Combine combine) const;
         
     private:
-        std::shared_ptr<SongNode> root_ptr_; /** Pointer to the root node of the Playlist */
+        static constexpr size_t kProbeGroupSize = 8; /** Probes searchMany walks down the tree together */
+        static constexpr size_t kRunsPerThread = 4; /** Runs a parallel walk cuts per pool thread, so early finishers can steal the rest */
+
+        /**
+         * @brief Which songs a set operation keeps
+         */
+        enum class SetOperation {
+            Union, /** Songs in either Playlist */
+            Intersection, /** Songs in both Playlists */
+            Difference /** Songs in the first Playlist only */
+        };
+
+        std::shared_ptr<NodePool<SongNode>> pool_; /** Storage for every node in the Playlist, shared with its copies. Made on first use */
+        SongNode* root_ptr_; /** Pointer to the root node of the Playlist */
+        std::shared_ptr<StringPool> strings_; /** Storage for the names too long to fit in a node, shared with its copies. Made on first use */
+        std::unique_ptr<Playlist> artist_index_; /** Same songs with song and artist swapped so they sort by artist, nullptr when disabled.
+                                                     Its nodes copy short names and view long ones in strings_, it never stores names of its own */
+#ifdef PLAYLIST_INSTRUMENTATION
+        mutable PlaylistStats stats_; /** Counters and latency histograms, mutable since searches count too */
+#endif
         /**
          * @brief uses recursion to cut the search time in half and compare each root_ptr with the key. Based on the comparison you search left or right. 
          * 
          * @param sub_song_ptr this is the current node we are looking at
-         * @param key in the search function we use the function getkey to combine the song name and artist
+         * @param key in the search function we use the function getkey to pair the song name and artist
          * @return true if you find the song and artist in the Playlist tree
          * @return false if the song and artist is not in the tree
          */
-        bool searchHelper( std::shared_ptr<SongNode> sub_song_ptr, const std::string key  )const;
+        bool searchHelper(SongNode* sub_song_ptr, const SongKey& key) const;
 
         /**
-         * @brief uses recursion to copy the root ptr and subtree nodes and stops when we reach a point where the old_tree_root_ptr is nullptr
-         * 
-         * @param old_tree_root_ptr 
-         * @return std::shared_ptr<SongNode> this is the copy og the old_tree_root_ptr
+         * @brief Get the node pool, making it if this Playlist does not have one yet
+         * @return The pool new nodes of this Playlist come from
          */
-        std::shared_ptr<SongNode> copyTree(const std::shared_ptr<SongNode> old_tree_root_ptr) const;
+        NodePool<SongNode>& pool();
 
         /**
-         * @brief this decides whether we place a node on the left or right of the root ptr.
-         * 
-         * @param subtree_ptr this represents the subtree we will compare the new_songnode_ptr with
-         * @param new_songnode_ptr we will compare the subtree with this param to determine if we still need to more down a node that is nullptr
-         * @return std::shared_ptr<SongNode> 
+         * @brief Get the string pool, making it if this Playlist does not have one yet
+         * @return The pool the names of new songs are stored in
          */
-        std::shared_ptr<SongNode> placeNode(std::shared_ptr<SongNode> subtree_ptr, std::shared_ptr<SongNode> new_songnode_ptr);
+        StringPool& strings();
+
+        using CountedKeys = std::vector<std::pair<SongKey, size_t>>; /** Sorted distinct songs, each with the count to give it */
 
         /**
-         * @brief resets each side of the tree by first reseting the leaves and moving up from there
-         * 
-         * @param sub_song_ptr used to access each node.
+         * @brief Make a node for a new song, copying short names into it or storing the title and interning the artist
+         * @param song The name of the song
+         * @param artist The name of the artist
+         * @return The new node, not linked into the tree yet
+         */
+        SongNode* createNode(std::string_view song, std::string_view artist);
+
+        /**
+         * @brief Add a song to a subtree, or bump its count if it is already there
+         * @param subtree_ptr The root of the subtree, reached through a link that is private to this Playlist
+         * @param key The song and artist to add
+         * @param count How much to add to the count of the song
+         * @param created Set to the new node if the song was not in the subtree, left unchanged otherwise
+         * @return The root of the subtree, to be stored in the link subtree_ptr was read from
+         */
+        SongNode* addValue(SongNode* subtree_ptr, const SongKey& key, size_t count, SongNode*& created);
+
+        /**
+         * @brief Collapse a sorted run of keys into distinct keys with how often each appears, skipping empty fields like add
+         * @param sorted_songs Keys in sorted order
+         * @return The distinct keys with their counts, in sorted order
+         */
+        static CountedKeys countRepeats(const std::vector<SongKey>& sorted_songs);
+
+        /**
+         * @brief Link a sorted run of new nodes for songs not yet in the tree, only used on the artist index
+         * @param added The new nodes in sorted order with no repeats among them
          */
-        void destroyTree(std::shared_ptr<SongNode> sub_song_ptr); 
+        void linkBatch(const std::vector<SongNode*>& added);
 
         /**
-         * @brief Get the Number Of Songs Helper object
-         *adds to the count each time that we move from the left or right of the tree. 
-         *
-         * @param subtree_ptr this is the tree and then recursively represents the sub trees
-         * @return size_t this is used to return the amount of songs/nodes in the Playlist tree
+         * @brief Make artist index nodes for songs of this Playlist, viewing the long names the songs already store
+         * @param songs The songs to index
+         * @return The new index nodes sorted by artist and then song, not linked to each other yet
          */
-        size_t getNumberOfSongsHelper( std::shared_ptr<SongNode> subtree_ptr) const;
+        std::vector<SongNode*> createIndexNodes(const std::vector<const SongNode*>& songs);
 
         /**
-         * @brief helper function for preorder traversal
-         * @param node_ptr The current node being processed 
-         * @param result Vector to store traversal result in 
+         * @brief Get a node this Playlist may change. A node linked from a copy of the Playlist is copied, the copy links
+         * to the same children and the link count of the shared node drops by one
+         * @param node_ptr The node reached through a link that is private to this Playlist, may be nullptr
+         * @return node_ptr itself if nothing else links to it, otherwise the new copy. The caller must store it in the
+         * link node_ptr was read from
          */
-        void preorderHelper(std::shared_ptr<SongNode> node_ptr, std::vector<SongNode>& result) const;
+        SongNode* mutableNode(SongNode* node_ptr);
 
         /**
-         * @brief helper function for preorder traversal
-         * @param node_ptr The current node being processed
-         * @param result Vector to store traversal result in 
+         * @brief Copy every shared node of a subtree so the whole subtree can be relinked in place
+         * @param node_ptr The root of the subtree, reached through a link that is private to this Playlist
+         * @return The root of the subtree, to be stored in the link node_ptr was read from
          */
-        void postorderHelper(std::shared_ptr<SongNode> node_ptr, std::vector<SongNode>& result) const;
+        SongNode* unshareTree(SongNode* node_ptr);
 
         /**
-         * @brief helper function to find the height of the tree
-         * @param sub_song_ptr this is used to traverse through the tree
-         * @return size_t the count for the height of the tree
+         * @brief this decides whether we place a node on the left or right of the root ptr.
+         * 
+         * @param subtree_ptr this represents the subtree we will compare the new_songnode_ptr with
+         * @param new_songnode_ptr we will compare the subtree with this param to determine if we still need to more down a node that is nullptr
+         * @return SongNode* 
          */
-        size_t getHeightHelper(std::shared_ptr<SongNode> sub_song_ptr) const;
+        SongNode* placeNode(SongNode* subtree_ptr, SongNode* new_songnode_ptr);
+
+        /**
+         * @brief drops this Playlist's link to a subtree, walking it with an explicit stack. Nodes nothing else links to
+         * go back to the pool and their children lose a link in turn, nodes still shared by a copy are left alone
+         * 
+         * @param sub_song_ptr used to access each node.
+         */
+        void releaseTree(SongNode* sub_song_ptr); 
 
         /**
          * @brief Remove a value from a subtree of the Playlist
          * @param sub_tree The subtree to remove the value from
-         * @param song The name of the song to be removed
-         * @param artist The name of the artist of the song
+         * @param key The song and artist to be removed
          * @param success Flag to indicate successful removal
          * @return Pointer to the subtree after value removal
          * @post Flag success is updated to true or false depending on if removal was successful
          */
-        std::shared_ptr<SongNode> removeValue(std::shared_ptr<SongNode> sub_tree, const std::string& song, const std::string& artist, bool& success);
+        SongNode* removeValue(SongNode* sub_tree, const SongKey& key, bool& success);
         
         /**
-         * @brief Remove a node from the Playlist
+         * @brief Remove a node from the Playlist and give it back to the pool
          * @param node_ptr The node to be removed
-         * @return Pointer to the node after removal
+         * @return Pointer to the subtree that takes the place of the removed node
          */
-        std::shared_ptr<SongNode> removeNode(std::shared_ptr<SongNode> node_ptr);
+        SongNode* removeNode(SongNode* node_ptr);
         
         /**
-         * @brief Remove the leftmost node from a subtree
+         * @brief Unlink the leftmost node from a subtree without destroying it
          * @param node_ptr The root of the subtree
-         * @param song The name of the song in the inorder successor
-         * @param artist The name of the artist of the inorder successor
+         * @param leftmost The node that was unlinked, the inorder successor when node_ptr is a right subtree
          * @return Pointer to the subtree after leftmost node removal
-         * @post Parameters song and artist updated with the song and artist in the inorder successor of the left node
+         * @post Parameter leftmost points to the unlinked node, whose children are left unchanged
          */
-        std::shared_ptr<SongNode> removeLeftmostNode(std::shared_ptr<SongNode> node_ptr, std::string& song, std::string& artist);
-        
-        /**
-         * @brief Helper function for inorder traversal
-         * @param node_ptr The current node being processed
-         * @param result Vector to store traversal result in
-         */
-        void inorderHelper(std::shared_ptr<SongNode> node_ptr, std::vector<SongNode>& result) const;
+        SongNode* removeLeftmostNode(SongNode* node_ptr, SongNode*& leftmost);
         
         /**
          * @brief Get the key for a song and artist
          * @param song The name of the song
          * @param artist The name of the artist of the song
-         * @return Key formed from song and artist names by adding the strings
+         * @return Key viewing the song and artist names, valid while both strings are alive
          */
-        std::string getKey(const std::string& song, const std::string& artist) const;
+        SongKey getKey(std::string_view song, std::string_view artist) const;
         
         /**
          * @brief Get the key for a SongNode
          * @param song The SongNode to get key from
-         * @return Key formed from the song and artist in the SongNode by adding the strings
+         * @return Key viewing the song and artist in the SongNode, valid until the node changes
+         */
+        SongKey getKey(const SongNode& song) const;
+
+        /**
+         * @brief Get the stored height of a subtree
+         * @param node_ptr The root of the subtree
+         * @return Height of the subtree, 0 if node_ptr is nullptr
+         */
+        size_t nodeHeight(SongNode* node_ptr) const;
+
+        /**
+         * @brief Turn distinct counted songs into nodes
+         * @param songs The songs in sorted order with the count each node starts with
+         * @return The new nodes in sorted order, not linked to each other yet
+         */
+        std::vector<SongNode*> createBatchNodes(const CountedKeys& songs);
+
+        /**
+         * @brief Link a sorted run of nodes into a perfectly balanced subtree, the middle node becoming the root
+         * @param nodes The nodes in sorted order
+         * @param first Index of the first node of the run
+         * @param last Index one past the last node of the run
+         * @return Pointer to the root of the subtree, nullptr for an empty run
+         */
+        SongNode* buildBalanced(const std::vector<SongNode*>& nodes, size_t first, size_t last);
+
+        /**
+         * @brief Build an inorder iterator positioned at the song at a given position by following the subtree sizes down
+         * @param k The 0 based position of the song in sorted order
+         * @return Iterator at position k, or the end iterator if k is not less than getNumberOfSongs()
+         */
+        SongIterator inorderAt(size_t k) const;
+
+        /**
+         * @brief Run a set operation on this Playlist and other, splitting the sorted songs into runs merged in parallel
+         * @param other The second Playlist
+         * @param operation Which songs to keep
+         * @param threads Most runs to merge at the same time
+         * @param min_songs_per_thread Fewest songs of the two inputs together to give each run
+         * @return New Playlist holding the songs kept, built balanced
+         */
+        Playlist combine(const Playlist& other, SetOperation operation, size_t threads, size_t min_songs_per_thread) const;
+
+        /**
+         * @brief Merge two sorted runs of songs, keeping the songs a set operation wants, each once
+         * @param first Songs from the first Playlist
+         * @param second Songs from the second Playlist, covering the same stretch of keys as first
+         * @param operation Which songs to keep
+         * @param kept Keys viewing the kept songs in the two trees with their counts in the result, appended in sorted order
+         */
+        static void mergeRuns(SongRange first, SongRange second, SetOperation operation, CountedKeys& kept);
+
+        /**
+         * @brief Build an inorder iterator positioned at the first song that does not order before a target
+         * @param is_before Called with a node, returns true while the node orders before the target. Must be true for a
+         * prefix of the sorted songs and false for the rest
+         * @return Iterator at the first node where is_before is false, or the end iterator if there is none
          */
-        std::string getKey(const SongNode& song) const;
+        template <typename IsBefore>
+        SongIterator inorderLowerBound(IsBefore is_before) const;
+
+        /**
+         * @brief Get the stored number of nodes in a subtree
+         * @param node_ptr The root of the subtree
+         * @return Number of nodes in the subtree, 0 if node_ptr is nullptr
+         */
+        size_t nodeSize(SongNode* node_ptr) const;
+
+        /**
+         * @brief Get the largest count in a subtree
+         * @param node_ptr The root of the subtree
+         * @return The largest count_ in the subtree, 0 if node_ptr is nullptr
+         */
+        size_t nodeMaxCount(SongNode* node_ptr) const;
+
+        /**
+         * @brief Recompute the stored height, size and largest count of a node from its children
+         * @param node_ptr The node to update
+         */
+        void updateMetadata(SongNode* node_ptr);
+
+        /**
+         * @brief Rotate a subtree to the left so its right child becomes the new root
+         * @param node_ptr The root of the subtree, private to this Playlist, must have a right child
+         * @return Pointer to the new root of the subtree, copied first if it was shared
+         */
+        SongNode* rotateLeft(SongNode* node_ptr);
+
+        /**
+         * @brief Rotate a subtree to the right so its left child becomes the new root
+         * @param node_ptr The root of the subtree, private to this Playlist, must have a left child
+         * @return Pointer to the new root of the subtree, copied first if it was shared
+         */
+        SongNode* rotateRight(SongNode* node_ptr);
+
+        /**
+         * @brief Restore the AVL property of a subtree after one of its children changed height by at most one
+         * @param node_ptr The root of the subtree, private to this Playlist
+         * @return Pointer to the root of the subtree after rotations
+         * @post The heights of the two children of the returned node differ by at most one
+         */
+        SongNode* rebalance(SongNode* node_ptr);
 };
 
+template <typename Visit>
+void Playlist::forEachParallel(ThreadPool& threads, Visit visit) const{
+    reduceParallel(threads, 0, [&visit](int&, const SongNode& song){ visit(song); }, [](int, int){ return 0; });
+}
+
+template <typename T, typename Visit, typename Combine>
+T Playlist::reduceParallel(ThreadPool& threads, T identity, Visit visit, Combine combine) const{
+    size_t count = getNumberOfSongs();
+    size_t runs = std::min(count, threads.size() * kRunsPerThread);
+    //every partial result gets cache lines of its own, so runs updating neighbouring partials do not bounce a line
+    //between cores. The wrapper also keeps a vector<bool> from packing them into shared words
+    struct alignas(64) Partial {
+        T value_;
+    };
+    std::vector<Partial> partials(runs, Partial{identity});
+    std::vector<std::function<void()>> tasks;
+    tasks.reserve(runs);
+    for(size_t i = 0; i < runs; i++){
+        size_t first = count * i / runs;
+        size_t last = count * (i + 1) / runs;
+        T& partial = partials[i].value_;
+        tasks.push_back([this, first, last, &partial, &visit](){
+            for(const SongNode& song : range(first, last - first)){
+                visit(partial, song);
+            }
+        });
+    }
+    threads.runAll(std::move(tasks));
+    T result = std::move(identity);
+    for(Partial& partial : partials){
+        result = combine(std::move(result), std::move(partial.value_));
+    }
+    return result;
+}
+
 #endif//PLAYLIST_H_
\ No newline at end of file
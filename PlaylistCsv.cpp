@@ -0,0 +1,220 @@
+/**
+ * @file PlaylistCsv.cpp
+ * @brief This is the implementation file of the PlaylistCsv interface
+ * @version 0.1
+ * @date 2024-07-14
+ * 
+ * @copyright Copyright (c) 2024
+ * 
+ */
+#include "PlaylistCsv.hpp"
+
+#include <charconv>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+namespace {
+
+/**
+ * @brief Where the parser is inside the current field
+ */
+enum class FieldState {
+    Start, /** Nothing read for this field yet */
+    Unquoted, /** Reading a plain field */
+    Quoted, /** Inside a quoted field */
+    QuoteInQuoted /** Just read a quote inside a quoted field, it either closes the field or starts a doubled quote */
+};
+
+/**
+ * @brief Write one field, quoting it if it holds the delimiter, a quote or a line break
+ * @param field The text of the field
+ * @param delimiter The delimiter of the file
+ * @param out The stream to write to
+ * @return Number of bytes written
+ */
+size_t writeField(std::string_view field, char delimiter, std::ostream& out){
+    if(field.find_first_of(std::string{delimiter, '"', '\n', '\r'}) == std::string_view::npos){
+        out.write(field.data(), field.size());
+        return field.size();
+    }
+    size_t written = 2;
+    out.put('"');
+    for(char c : field){
+        if(c == '"'){
+            out.put('"');
+            written++;
+        }
+        out.put(c);
+        written++;
+    }
+    out.put('"');
+    return written;
+}
+
+}
+
+CsvImportStats PlaylistCsv::importFrom(std::istream& in, Playlist& playlist, char delimiter, size_t batch_size){
+    CsvImportStats stats;
+    std::vector<char> chunk(kDefaultChunkSize);
+    std::vector<std::pair<std::string, std::string>> batch;
+    batch.reserve(batch_size);
+    //records with a count field are added with their count instead of being repeated in the batch
+    std::vector<std::pair<std::pair<std::string, std::string>, size_t>> counted;
+
+    //the record being read: its first three fields, how many fields it has and whether anything was read at all
+    std::string song;
+    std::string artist;
+    std::string count_field;
+    size_t field_index = 0;
+    bool record_started = false;
+    FieldState state = FieldState::Start;
+    //a \r outside quotes is held back until the next byte shows whether it starts a \r\n line break
+    bool pending_cr = false;
+
+    auto append = [&](char c){
+        if(field_index == 0){
+            song.push_back(c);
+        }
+        else if(field_index == 1){
+            artist.push_back(c);
+        }
+        else if(field_index == 2){
+            count_field.push_back(c);
+        }
+        record_started = true;
+    };
+    auto endField = [&](){
+        field_index++;
+        record_started = true;
+        state = FieldState::Start;
+    };
+    auto flushBatch = [&](){
+        stats.songs_added_ += playlist.addBatch(batch);
+        batch.clear();
+        for(const auto& record : counted){
+            const auto& counted_song = record.first;
+            if(playlist.getCount(counted_song.first, counted_song.second) == 0){
+                stats.songs_added_++;
+            }
+            playlist.add(counted_song.first, counted_song.second, record.second);
+        }
+        counted.clear();
+    };
+    auto endRecord = [&](){
+        //blank lines are skipped rather than rejected
+        if(record_started){
+            stats.records_read_++;
+            //the same rule as Playlist::add: both names must be there and not empty, and a count must be a positive number
+            size_t count = 1;
+            bool valid = (field_index == 1 || field_index == 2) && song != "" && artist != "";
+            if(valid && field_index == 2){
+                const char* last = count_field.data() + count_field.size();
+                auto result = std::from_chars(count_field.data(), last, count);
+                valid = result.ec == std::errc() && result.ptr == last && count > 0;
+            }
+            if(valid){
+                if(count == 1){
+                    batch.emplace_back(std::move(song), std::move(artist));
+                }
+                else{
+                    counted.emplace_back(std::make_pair(std::move(song), std::move(artist)), count);
+                }
+                if(batch.size() + counted.size() >= batch_size){
+                    flushBatch();
+                }
+            }
+            else{
+                stats.records_rejected_++;
+            }
+        }
+        song.clear();
+        artist.clear();
+        count_field.clear();
+        field_index = 0;
+        record_started = false;
+        state = FieldState::Start;
+    };
+
+    while(in){
+        in.read(chunk.data(), chunk.size());
+        size_t count = static_cast<size_t>(in.gcount());
+        stats.bytes_read_ += count;
+        for(size_t i = 0; i < count; i++){
+            char c = chunk[i];
+            switch(state){
+                case FieldState::Quoted:
+                    if(c == '"'){
+                        state = FieldState::QuoteInQuoted;
+                    }
+                    else{
+                        append(c);
+                    }
+                    break;
+                case FieldState::QuoteInQuoted:
+                    if(c == '"'){
+                        append(c);
+                        state = FieldState::Quoted;
+                        break;
+                    }
+                    //the quote closed the field, anything but a delimiter or line break after it is kept as plain text
+                    state = FieldState::Unquoted;
+                    [[fallthrough]];
+                case FieldState::Start:
+                case FieldState::Unquoted:
+                    if(pending_cr){
+                        pending_cr = false;
+                        if(c != '\n'){
+                            append('\r');
+                            state = FieldState::Unquoted;
+                        }
+                    }
+                    if(c == delimiter){
+                        endField();
+                    }
+                    else if(c == '\n'){
+                        endRecord();
+                    }
+                    else if(c == '\r'){
+                        pending_cr = true;
+                    }
+                    else if(c == '"' && state == FieldState::Start){
+                        state = FieldState::Quoted;
+                        record_started = true;
+                    }
+                    else{
+                        append(c);
+                        state = FieldState::Unquoted;
+                    }
+                    break;
+            }
+        }
+    }
+    //the last record may not end with a line break, a \r left at the very end is taken as one
+    endRecord();
+    if(!batch.empty() || !counted.empty()){
+        flushBatch();
+    }
+    return stats;
+}
+
+size_t PlaylistCsv::exportTo(const Playlist& playlist, std::ostream& out, char delimiter){
+    size_t written = 0;
+    for(const SongNode& song : playlist){
+        written += writeField(song.song(), delimiter, out);
+        out.put(delimiter);
+        written += writeField(song.artist(), delimiter, out);
+        written++;
+        //the count only when it is not the default, so a playlist of distinct songs stays a plain two column file
+        if(song.count_ > 1){
+            std::string count = std::to_string(song.count_);
+            out.put(delimiter);
+            out.write(count.data(), count.size());
+            written += 1 + count.size();
+        }
+        out.put('\n');
+        written++;
+    }
+    return written;
+}
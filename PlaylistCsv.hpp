@@ -0,0 +1,66 @@
+/**
+ * @file PlaylistCsv.hpp
+ * @brief This is the interface for streaming songs between a Playlist and CSV or TSV text
+ * @version 0.1
+ * @date 2024-07-14
+ * 
+ * @copyright Copyright (c) 2024
+ * 
+ */
+
+#ifndef PLAYLIST_CSV_H_
+#define PLAYLIST_CSV_H_
+
+#include <cstddef>
+#include <istream>
+#include <ostream>
+
+#include "Playlist.hpp"
+
+/**
+ * @brief Counts reported by PlaylistCsv::importFrom
+ */
+struct CsvImportStats {
+    size_t bytes_read_ = 0; /** Number of bytes read from the stream */
+    size_t records_read_ = 0; /** Number of non blank records read */
+    size_t songs_added_ = 0; /** Number of songs that were not in the Playlist before */
+    size_t records_rejected_ = 0; /** Records without two or three fields, with an empty song or artist or with a count that is not a positive number */
+};
+
+/**
+ * @brief Reads and writes song,artist records one line per song.
+ * 
+ * A third field holds how many times the song was added. It is optional, a record without it counts once, and export
+ * only writes it for songs added more than once.
+ * 
+ * Fields that hold the delimiter, a quote or a line break are wrapped in double quotes with inner quotes doubled, as in
+ * RFC 4180. Lines may end in \n or \r\n, a \r anywhere else is kept as part of its field. Pass ',' for CSV or '\t' for TSV. Both directions stream: import reads fixed size chunks and hands the
+ * records to Playlist::addBatch a batch at a time, export writes each song while walking the tree.
+ */
+class PlaylistCsv {
+    public:
+        static constexpr size_t kDefaultChunkSize = 1 << 16; /** Bytes read from the stream at a time */
+        static constexpr size_t kDefaultBatchSize = 1 << 16; /** Records handed to Playlist::addBatch at a time */
+
+        /**
+         * @brief Add every song,artist or song,artist,count record of a stream to a Playlist
+         * @param in The stream to read, for example an std::ifstream opened in binary mode or std::cin
+         * @param playlist The Playlist to add the songs to
+         * @param delimiter The character between the song and the artist
+         * @param batch_size Number of records collected before they are added, bounds the memory used besides the Playlist
+         * @return Counts of what was read, added and rejected
+         */
+        static CsvImportStats importFrom(std::istream& in, Playlist& playlist, char delimiter = ',', size_t batch_size = kDefaultBatchSize);
+
+        /**
+         * @brief Write every song of a Playlist as one record in sorted order, without copying the songs first. Songs added more
+         * than once get a third field with their count
+         * @param playlist The Playlist to write
+         * @param out The stream to write to
+         * @param delimiter The character between the song and the artist
+         * @return Number of bytes written
+         */
+        static size_t exportTo(const Playlist& playlist, std::ostream& out, char delimiter = ',');
+};
+
+#endif//PLAYLIST_CSV_H_
@@ -0,0 +1,301 @@
+/**
+ * @file PlaylistImage.cpp
+ * @brief This is the implementation file of the PlaylistImage interface
+ * @version 0.1
+ * @date 2024-07-14
+ * 
+ * @copyright Copyright (c) 2024
+ * 
+ */
+#include "PlaylistImage.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <limits>
+#include <stdexcept>
+#include <unordered_map>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+
+constexpr size_t kWriteBufferSize = 1 << 20; /** Bytes of the image collected before each write */
+
+/**
+ * @brief Write every byte of a buffer to a file, retrying short writes
+ */
+void writeAll(int fd, const std::string& data, const std::string& path){
+    size_t written = 0;
+    while(written < data.size()){
+        ssize_t result = ::write(fd, data.data() + written, data.size() - written);
+        if(result < 0){
+            if(errno == EINTR){
+                continue;
+            }
+            throw std::runtime_error("PlaylistImage::save: failed writing " + path);
+        }
+        written += static_cast<size_t>(result);
+    }
+}
+
+/**
+ * @brief Sync the directory holding a file so a rename onto it survives a crash
+ */
+void syncParentDirectory(const std::string& path){
+    size_t slash = path.rfind('/');
+    std::string directory = slash == std::string::npos ? "." : slash == 0 ? "/" : path.substr(0, slash);
+    int fd = ::open(directory.c_str(), O_RDONLY);
+    if(fd < 0){
+        throw std::runtime_error("PlaylistImage::save: cannot open " + directory);
+    }
+    int result = ::fsync(fd);
+    ::close(fd);
+    if(result != 0){
+        throw std::runtime_error("PlaylistImage::save: cannot sync " + directory);
+    }
+}
+
+}
+
+void PlaylistImage::save(const Playlist& playlist, const std::string& path){
+    //give every distinct artist a position in the artist table, in the order the artists first appear. The views point
+    //into the nodes and the string pool of the playlist, which stay put while it is being saved
+    std::unordered_map<std::string_view, uint32_t> artist_ids;
+    std::vector<std::string_view> artists;
+    Header header{};
+    std::memcpy(header.magic_, kMagic, sizeof(kMagic));
+    header.song_count_ = playlist.getNumberOfSongs();
+    header.strings_size_ = 0;
+    for(const SongNode& song : playlist){
+        if(song.song().size() > std::numeric_limits<uint32_t>::max()){
+            throw std::runtime_error("PlaylistImage::save: a song name is too long for the image format");
+        }
+        header.strings_size_ += song.song().size();
+        if(artist_ids.find(song.artist()) == artist_ids.end()){
+            if(artists.size() == std::numeric_limits<uint32_t>::max()){
+                throw std::runtime_error("PlaylistImage::save: too many artists for the image format");
+            }
+            artist_ids.emplace(song.artist(), static_cast<uint32_t>(artists.size()));
+            artists.push_back(song.artist());
+            header.strings_size_ += song.artist().size();
+        }
+    }
+    header.artist_count_ = artists.size();
+    header.records_offset_ = sizeof(Header);
+    header.artists_offset_ = header.records_offset_ + header.song_count_ * sizeof(Record);
+    header.strings_offset_ = header.artists_offset_ + header.artist_count_ * sizeof(Artist);
+
+    //the image is written to a temporary file next to path and renamed over it once it is synced, so a crash or a failed
+    //write leaves the previous image in place instead of a half written one. mkstemp picks a name no other save uses
+    std::string temporary_path = path + ".XXXXXX";
+    int fd = ::mkstemp(&temporary_path[0]);
+    if(fd < 0){
+        throw std::runtime_error("PlaylistImage::save: cannot create a temporary file next to " + path);
+    }
+    try{
+        //mkstemp creates the file readable by its owner only
+        if(::fchmod(fd, 0644) != 0){
+            throw std::runtime_error("PlaylistImage::save: cannot set the mode of " + temporary_path);
+        }
+        std::string buffer(reinterpret_cast<const char*>(&header), sizeof(header));
+        auto flush_if_full = [&](){
+            if(buffer.size() >= kWriteBufferSize){
+                writeAll(fd, buffer, temporary_path);
+                buffer.clear();
+            }
+        };
+        //records first, each pointing at where its song name lands in the pool and at its artist in the table
+        uint64_t strings_offset = 0;
+        for(const SongNode& song : playlist){
+            Record record{};
+            record.song_offset_ = strings_offset;
+            record.song_length_ = static_cast<uint32_t>(song.song().size());
+            record.artist_ = artist_ids.find(song.artist())->second;
+            record.count_ = song.count_;
+            strings_offset += record.song_length_;
+            buffer.append(reinterpret_cast<const char*>(&record), sizeof(record));
+            flush_if_full();
+        }
+        //then the artist table, whose names follow the song names in the pool
+        for(std::string_view artist : artists){
+            Artist entry{};
+            entry.offset_ = strings_offset;
+            entry.length_ = artist.size();
+            strings_offset += entry.length_;
+            buffer.append(reinterpret_cast<const char*>(&entry), sizeof(entry));
+            flush_if_full();
+        }
+        //then the names in the same order
+        for(const SongNode& song : playlist){
+            buffer.append(song.song());
+            flush_if_full();
+        }
+        for(std::string_view artist : artists){
+            buffer.append(artist);
+            flush_if_full();
+        }
+        writeAll(fd, buffer, temporary_path);
+        if(::fsync(fd) != 0){
+            throw std::runtime_error("PlaylistImage::save: cannot sync " + temporary_path);
+        }
+    }
+    catch(...){
+        ::close(fd);
+        ::unlink(temporary_path.c_str());
+        throw;
+    }
+    if(::close(fd) != 0){
+        ::unlink(temporary_path.c_str());
+        throw std::runtime_error("PlaylistImage::save: failed writing " + temporary_path);
+    }
+    if(::rename(temporary_path.c_str(), path.c_str()) != 0){
+        ::unlink(temporary_path.c_str());
+        throw std::runtime_error("PlaylistImage::save: cannot replace " + path);
+    }
+    syncParentDirectory(path);
+}
+
+PlaylistImage::PlaylistImage(const std::string& path) :
+    data_(nullptr), size_(0), header_(nullptr), records_(nullptr), artists_(nullptr), strings_(nullptr){
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if(fd < 0){
+        throw std::runtime_error("PlaylistImage: cannot open " + path);
+    }
+    struct stat file_stat;
+    if(::fstat(fd, &file_stat) != 0 || static_cast<size_t>(file_stat.st_size) < sizeof(Header)){
+        ::close(fd);
+        throw std::runtime_error("PlaylistImage: " + path + " is too small to be an image");
+    }
+    size_ = static_cast<size_t>(file_stat.st_size);
+    void* mapping = ::mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+    //the mapping keeps its own reference to the file
+    ::close(fd);
+    if(mapping == MAP_FAILED){
+        throw std::runtime_error("PlaylistImage: cannot map " + path);
+    }
+    data_ = static_cast<const unsigned char*>(mapping);
+    header_ = reinterpret_cast<const Header*>(data_);
+
+    //check every offset against the file size once so lookups never have to
+    bool valid = std::memcmp(header_->magic_, kMagic, sizeof(kMagic)) == 0
+        && header_->records_offset_ == sizeof(Header)
+        && header_->song_count_ <= (size_ - sizeof(Header)) / sizeof(Record)
+        && header_->artists_offset_ == header_->records_offset_ + header_->song_count_ * sizeof(Record)
+        && header_->artist_count_ <= (size_ - header_->artists_offset_) / sizeof(Artist)
+        && header_->strings_offset_ == header_->artists_offset_ + header_->artist_count_ * sizeof(Artist)
+        && header_->strings_size_ <= size_ - header_->strings_offset_;
+    if(valid){
+        records_ = reinterpret_cast<const Record*>(data_ + header_->records_offset_);
+        artists_ = reinterpret_cast<const Artist*>(data_ + header_->artists_offset_);
+        strings_ = reinterpret_cast<const char*>(data_ + header_->strings_offset_);
+        for(size_t i = 0; i < header_->song_count_ && valid; i++){
+            const Record& record = records_[i];
+            valid = record.song_offset_ <= header_->strings_size_
+                && record.song_length_ <= header_->strings_size_ - record.song_offset_
+                && record.artist_ < header_->artist_count_;
+        }
+        for(size_t i = 0; i < header_->artist_count_ && valid; i++){
+            const Artist& artist = artists_[i];
+            valid = artist.offset_ <= header_->strings_size_ && artist.length_ <= header_->strings_size_ - artist.offset_;
+        }
+    }
+    if(!valid){
+        ::munmap(const_cast<unsigned char*>(data_), size_);
+        throw std::runtime_error("PlaylistImage: " + path + " is not a valid image");
+    }
+}
+
+PlaylistImage::PlaylistImage(PlaylistImage&& other) noexcept :
+    data_(other.data_), size_(other.size_), header_(other.header_), records_(other.records_), artists_(other.artists_),
+    strings_(other.strings_){
+    other.data_ = nullptr;
+    other.size_ = 0;
+    other.header_ = nullptr;
+    other.records_ = nullptr;
+    other.artists_ = nullptr;
+    other.strings_ = nullptr;
+}
+
+PlaylistImage& PlaylistImage::operator=(PlaylistImage&& other) noexcept{
+    if(this != &other){
+        if(data_ != nullptr){
+            ::munmap(const_cast<unsigned char*>(data_), size_);
+        }
+        data_ = other.data_;
+        size_ = other.size_;
+        header_ = other.header_;
+        records_ = other.records_;
+        artists_ = other.artists_;
+        strings_ = other.strings_;
+        other.data_ = nullptr;
+        other.size_ = 0;
+        other.header_ = nullptr;
+        other.records_ = nullptr;
+        other.artists_ = nullptr;
+        other.strings_ = nullptr;
+    }
+    return *this;
+}
+
+PlaylistImage::~PlaylistImage(){
+    if(data_ != nullptr){
+        ::munmap(const_cast<unsigned char*>(data_), size_);
+    }
+}
+
+size_t PlaylistImage::getNumberOfSongs() const{
+    return header_ == nullptr ? 0 : header_->song_count_;
+}
+
+bool PlaylistImage::isEmpty() const{
+    return getNumberOfSongs() == 0;
+}
+
+bool PlaylistImage::search(std::string_view song, std::string_view artist) const{
+    return positionOf(song, artist) < getNumberOfSongs();
+}
+
+size_t PlaylistImage::getCount(std::string_view song, std::string_view artist) const{
+    size_t position = positionOf(song, artist);
+    return position < getNumberOfSongs() ? records_[position].count_ : 0;
+}
+
+SongKey PlaylistImage::at(size_t k) const{
+    if(k >= getNumberOfSongs()){
+        throw std::out_of_range("PlaylistImage::at: position " + std::to_string(k) + " is past the last song");
+    }
+    return keyAt(k);
+}
+
+size_t PlaylistImage::positionOf(std::string_view song, std::string_view artist) const{
+    SongKey key(song, artist);
+    //binary search over the records, which is a walk down the implicit balanced tree
+    size_t first = 0;
+    size_t last = getNumberOfSongs();
+    while(first < last){
+        size_t middle = first + (last - first) / 2;
+        int order = keyAt(middle).compare(key);
+        if(order == 0){
+            return middle;
+        }
+        if(order < 0){
+            first = middle + 1;
+        }
+        else{
+            last = middle;
+        }
+    }
+    return getNumberOfSongs();
+}
+
+SongKey PlaylistImage::keyAt(size_t k) const{
+    const Record& record = records_[k];
+    const Artist& artist = artists_[record.artist_];
+    return SongKey(std::string_view(strings_ + record.song_offset_, record.song_length_),
+        std::string_view(strings_ + artist.offset_, artist.length_));
+}
@@ -0,0 +1,212 @@
+/**
+ * @file PlaylistImage.hpp
+ * @brief This is the interface of a read only Playlist stored in a compact binary file that is searched straight from memory mapped pages
+ * @version 0.1
+ * @date 2024-07-14
+ * 
+ * @copyright Copyright (c) 2024
+ * 
+ */
+
+#ifndef PLAYLIST_IMAGE_H_
+#define PLAYLIST_IMAGE_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <string>
+#include <string_view>
+
+#include "Playlist.hpp"
+
+/**
+ * @brief A read only view of a Playlist saved with PlaylistImage::save.
+ * 
+ * The file is a header, then one fixed size record per song in sorted order, then a table with one entry per distinct
+ * artist, then a pool with the bytes of every song name followed by each artist name once. Records refer to their
+ * artist by its position in the table, so an artist with many songs is stored a single time. A sorted array is a perfectly balanced tree laid out implicitly, so search is a binary search over
+ * the records and inorder traversal is a scan, both reading the mapped pages directly without building any nodes.
+ * Opening an image costs one mmap no matter how many songs it holds.
+ * 
+ * Numbers are stored in the byte order of the machine that wrote the file, so an image should be read on the same
+ * kind of machine.
+ */
+class PlaylistImage {
+    public:
+        /**
+         * @brief Forward iterator over the songs of an image in sorted order
+         */
+        class Iterator {
+            public:
+                using iterator_category = std::forward_iterator_tag;
+                using value_type = SongKey;
+                using difference_type = std::ptrdiff_t;
+                using pointer = void;
+                using reference = SongKey;
+
+                /**
+                 * @brief Constructor for an Iterator object
+                 * @param image The image to walk
+                 * @param index Position of the song in sorted order
+                 */
+                Iterator(const PlaylistImage* image, size_t index) : image_(image), index_(index) {}
+
+                /**
+                 * @brief Get the song the iterator is positioned at
+                 * @return Key viewing the song and artist in the mapped file, valid while the image is open
+                 */
+                SongKey operator*() const { return image_->keyAt(index_); }
+
+                Iterator& operator++() {
+                    index_++;
+                    return *this;
+                }
+
+                Iterator operator++(int) {
+                    Iterator before = *this;
+                    index_++;
+                    return before;
+                }
+
+                bool operator==(const Iterator& other) const { return index_ == other.index_; }
+                bool operator!=(const Iterator& other) const { return index_ != other.index_; }
+
+            private:
+                const PlaylistImage* image_; /** The image being walked */
+                size_t index_; /** Position of the current song in sorted order */
+        };
+
+        /**
+         * @brief Write a Playlist to a binary image file, streaming the songs in inorder without copying them
+         * @param playlist The Playlist to save
+         * @param path The file to write. An existing file is replaced in one rename once the new image is synced, so it
+         * is never left half written
+         * @throw std::runtime_error if the file cannot be written, then any previous image at path is left as it was
+         */
+        static void save(const Playlist& playlist, const std::string& path);
+
+        /**
+         * @brief Constructor that maps an image file read only
+         * @param path The file written by save
+         * @throw std::runtime_error if the file cannot be opened or is not a valid image
+         */
+        explicit PlaylistImage(const std::string& path);
+
+        PlaylistImage(const PlaylistImage&) = delete;
+        PlaylistImage& operator=(const PlaylistImage&) = delete;
+
+        /**
+         * @brief Move constructor for PlaylistImage, the mapping changes hands
+         * @param other The PlaylistImage object to be moved
+         */
+        PlaylistImage(PlaylistImage&& other) noexcept;
+
+        /**
+         * @brief Move assignment operator for PlaylistImage
+         * @param other The PlaylistImage object to be moved
+         * @return Reference to the moved PlaylistImage object
+         */
+        PlaylistImage& operator=(PlaylistImage&& other) noexcept;
+
+        /**
+         * @brief Destructor for PlaylistImage, unmaps the file
+         */
+        ~PlaylistImage();
+
+        /**
+         * @brief Get the number of songs in the image
+         * @return Number of songs in the image
+         */
+        size_t getNumberOfSongs() const;
+
+        /**
+         * @brief Check if the image is empty
+         * @return True if the image holds no songs, otherwise false
+         */
+        bool isEmpty() const;
+
+        /**
+         * @brief Search for a song with a binary search over the mapped records, in O(log n)
+         * @param song The name of the song to search for
+         * @param artist The name of the artist of the song
+         * @return True if the song was found, otherwise false
+         */
+        bool search(std::string_view song, std::string_view artist) const;
+
+        /**
+         * @brief Get the number of times a song was added to the Playlist that was saved, in O(log n)
+         * @param song The name of the song
+         * @param artist The name of the artist of the song
+         * @return The count of the song, 0 if it is not in the image
+         */
+        size_t getCount(std::string_view song, std::string_view artist) const;
+
+        /**
+         * @brief Get the song at a position in sorted order in O(1)
+         * @param k The 0 based position of the song
+         * @return Key viewing the song and artist in the mapped file, valid while the image is open
+         * @throw std::out_of_range if k is not less than getNumberOfSongs()
+         */
+        SongKey at(size_t k) const;
+
+        Iterator begin() const { return Iterator(this, 0); }
+        Iterator end() const { return Iterator(this, getNumberOfSongs()); }
+
+    private:
+        /**
+         * @brief Fixed size start of every image file
+         */
+        struct Header {
+            char magic_[8]; /** Always kMagic, marks the file as a Playlist image */
+            uint64_t song_count_; /** Number of song records */
+            uint64_t artist_count_; /** Number of entries in the artist table */
+            uint64_t records_offset_; /** Offset of the first record from the start of the file */
+            uint64_t artists_offset_; /** Offset of the artist table from the start of the file */
+            uint64_t strings_offset_; /** Offset of the string pool from the start of the file */
+            uint64_t strings_size_; /** Number of bytes in the string pool */
+        };
+
+        /**
+         * @brief Where the name of one song sits in the string pool, which artist it is by, and how many times it was added
+         */
+        struct Record {
+            uint64_t song_offset_; /** Offset of the song name from the start of the string pool */
+            uint64_t count_; /** Number of times the song was added */
+            uint32_t song_length_; /** Number of bytes in the song name */
+            uint32_t artist_; /** Position of the artist in the artist table */
+        };
+
+        /**
+         * @brief Where the name of one distinct artist sits in the string pool
+         */
+        struct Artist {
+            uint64_t offset_; /** Offset of the artist name from the start of the string pool */
+            uint64_t length_; /** Number of bytes in the artist name */
+        };
+
+        static constexpr char kMagic[8] = {'P', 'L', 'S', 'T', 'I', 'M', 'G', '3'}; /** Marks an image file, the last byte is the format version */
+
+        /**
+         * @brief Binary search for a song
+         * @param song The name of the song
+         * @param artist The name of the artist of the song
+         * @return The position of the song in sorted order, getNumberOfSongs() if it is not in the image
+         */
+        size_t positionOf(std::string_view song, std::string_view artist) const;
+
+        /**
+         * @brief Get the key of the song at a position without checking the position
+         * @param k The 0 based position of the song, less than getNumberOfSongs()
+         * @return Key viewing the song and artist in the mapped file
+         */
+        SongKey keyAt(size_t k) const;
+
+        const unsigned char* data_; /** Start of the mapped file, nullptr once moved from */
+        size_t size_; /** Number of mapped bytes */
+        const Header* header_; /** The header at the start of the mapping */
+        const Record* records_; /** The song records in sorted order */
+        const Artist* artists_; /** The artist table */
+        const char* strings_; /** The string pool */
+};
+
+#endif//PLAYLIST_IMAGE_H_
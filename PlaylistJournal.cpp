@@ -0,0 +1,365 @@
+/**
+ * @file PlaylistJournal.cpp
+ * @brief This is the implementation file of the PlaylistJournal interface
+ * @version 0.1
+ * @date 2024-07-14
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+#include "PlaylistJournal.hpp"
+
+#include <cerrno>
+#include <cstring>
+#include <fstream>
+#include <limits>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+PlaylistJournal::PlaylistJournal(const std::string& directory, const JournalOptions& options) :
+    directory_(directory), snapshot_path_(directory + "/playlist.snapshot"), log_path_(directory + "/playlist.log"),
+    options_(options), pending_records_(0), log_fd_(-1), log_bytes_(0), snapshot_bytes_(0), generation_(0), broken_(false){
+    if(::mkdir(directory_.c_str(), 0755) != 0 && errno != EEXIST){
+        throw std::runtime_error("PlaylistJournal: cannot create " + directory_);
+    }
+    loadSnapshot();
+    recoverLog();
+}
+
+PlaylistJournal::~PlaylistJournal(){
+    //a destructor cannot report a failed write, the changes in the buffer are then lost like on a crash
+    try{
+        commit();
+    }
+    catch(...){
+    }
+    if(log_fd_ >= 0){
+        ::close(log_fd_);
+    }
+}
+
+bool PlaylistJournal::add(std::string_view song, std::string_view artist, size_t count){
+    checkUsable();
+    if(!playlist_.add(song, artist, count)){
+        return false;
+    }
+    log(RecordType::Add, song, artist, count);
+    return true;
+}
+
+bool PlaylistJournal::remove(std::string_view song, std::string_view artist){
+    checkUsable();
+    if(!playlist_.remove(song, artist)){
+        return false;
+    }
+    log(RecordType::Remove, song, artist, 0);
+    return true;
+}
+
+void PlaylistJournal::clear(){
+    checkUsable();
+    playlist_.clear();
+    log(RecordType::Clear, "", "", 0);
+}
+
+void PlaylistJournal::commit(){
+    checkUsable();
+    if(pending_.empty()){
+        return;
+    }
+    try{
+        writeAll(log_fd_, pending_, log_path_);
+        if(options_.sync_ != SyncPolicy::None && ::fsync(log_fd_) != 0){
+            throw std::runtime_error("PlaylistJournal: cannot sync " + log_path_);
+        }
+    }
+    catch(...){
+        //part of the group may already be in the log. Cut it back to the last commit so a retry writes the group once
+        //and whole, instead of after a torn record that recovery would stop at. If even that fails the log can no
+        //longer be trusted to take more records
+        if(::ftruncate(log_fd_, static_cast<off_t>(log_bytes_)) != 0){
+            broken_ = true;
+        }
+        throw;
+    }
+    log_bytes_ += pending_.size();
+    pending_.clear();
+    pending_records_ = 0;
+    //rewriting the snapshot costs about as much as the snapshot is big, so wait until the log has grown at least as big
+    if(options_.compact_after_bytes_ != 0 && log_bytes_ >= options_.compact_after_bytes_ && log_bytes_ >= snapshot_bytes_){
+        compact();
+    }
+}
+
+void PlaylistJournal::compact(){
+    commit();
+    //the snapshot gets the next generation before the log does. A crash in between leaves a log one generation behind
+    //the snapshot, which recovery knows is already part of the snapshot
+    uint64_t next_generation = generation_ + 1;
+    FileHeader header{};
+    std::memcpy(header.magic_, kMagic, sizeof(kMagic));
+    header.generation_ = next_generation;
+    std::string buffer(reinterpret_cast<const char*>(&header), sizeof(header));
+    std::string temporary_path = snapshot_path_ + ".tmp";
+    int fd = ::open(temporary_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if(fd < 0){
+        throw std::runtime_error("PlaylistJournal: cannot open " + temporary_path);
+    }
+    size_t written = 0;
+    try{
+        for(const SongNode& song : playlist_){
+            appendRecord(RecordType::Add, song.song(), song.artist(), song.count_, buffer);
+            if(buffer.size() >= kSnapshotBufferSize){
+                writeAll(fd, buffer, temporary_path);
+                written += buffer.size();
+                buffer.clear();
+            }
+        }
+        writeAll(fd, buffer, temporary_path);
+        written += buffer.size();
+        if(::fsync(fd) != 0){
+            throw std::runtime_error("PlaylistJournal: cannot sync " + temporary_path);
+        }
+    }
+    catch(...){
+        ::close(fd);
+        ::unlink(temporary_path.c_str());
+        throw;
+    }
+    ::close(fd);
+    if(::rename(temporary_path.c_str(), snapshot_path_.c_str()) != 0){
+        throw std::runtime_error("PlaylistJournal: cannot replace " + snapshot_path_);
+    }
+    snapshot_bytes_ = written;
+    //the snapshot on disk is now a generation ahead of the open log, and recovery skips that log. Records appended to it
+    //would be lost, so if the new log cannot be started the journal takes no more changes. Reopening it recovers
+    //everything from the snapshot
+    try{
+        syncDirectory();
+        startLog(next_generation);
+    }
+    catch(...){
+        broken_ = true;
+        throw;
+    }
+}
+
+const Playlist& PlaylistJournal::playlist() const{
+    return playlist_;
+}
+
+size_t PlaylistJournal::logBytes() const{
+    return log_bytes_;
+}
+
+uint64_t PlaylistJournal::generation() const{
+    return generation_;
+}
+
+void PlaylistJournal::appendRecord(RecordType type, std::string_view song, std::string_view artist, uint64_t count, std::string& out){
+    if(song.size() > std::numeric_limits<uint32_t>::max() || artist.size() > std::numeric_limits<uint32_t>::max()){
+        throw std::runtime_error("PlaylistJournal: a song or artist name is too long for the log format");
+    }
+    RecordHeader header{};
+    header.count_ = count;
+    header.song_length_ = static_cast<uint32_t>(song.size());
+    header.artist_length_ = static_cast<uint32_t>(artist.size());
+    header.type_ = static_cast<uint32_t>(type);
+    header.checksum_ = checksumOf(header, song, artist);
+    out.append(reinterpret_cast<const char*>(&header), sizeof(header));
+    out.append(song);
+    out.append(artist);
+}
+
+uint64_t PlaylistJournal::checksumOf(const RecordHeader& header, std::string_view song, std::string_view artist){
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    auto mix = [&hash](const char* data, size_t size){
+        for(size_t i = 0; i < size; i++){
+            hash = (hash ^ static_cast<unsigned char>(data[i])) * 0x100000001b3ULL;
+        }
+    };
+    const char* fields = reinterpret_cast<const char*>(&header) + sizeof(header.checksum_);
+    mix(fields, sizeof(header) - sizeof(header.checksum_));
+    mix(song.data(), song.size());
+    mix(artist.data(), artist.size());
+    return hash;
+}
+
+void PlaylistJournal::log(RecordType type, std::string_view song, std::string_view artist, uint64_t count){
+    appendRecord(type, song, artist, count, pending_);
+    pending_records_++;
+    if(options_.sync_ == SyncPolicy::Always || pending_records_ >= options_.group_size_){
+        commit();
+    }
+}
+
+void PlaylistJournal::loadSnapshot(){
+    std::ifstream in(snapshot_path_, std::ios::binary);
+    if(!in){
+        return;
+    }
+    FileHeader header{};
+    if(!in.read(reinterpret_cast<char*>(&header), sizeof(header)) || std::memcmp(header.magic_, kMagic, sizeof(kMagic)) != 0){
+        throw std::runtime_error("PlaylistJournal: " + snapshot_path_ + " is not a valid snapshot");
+    }
+    generation_ = header.generation_;
+    snapshot_bytes_ = sizeof(header);
+    size_t file_bytes = fileSize(snapshot_path_);
+
+    //the songs were written in sorted order, so the tree is built in one go and the counts topped up afterwards
+    std::vector<std::pair<std::string, std::string>> songs;
+    std::vector<std::pair<size_t, uint64_t>> repeats;
+    RecordHeader record{};
+    while(in.read(reinterpret_cast<char*>(&record), sizeof(record))){
+        if(static_cast<uint64_t>(record.song_length_) + record.artist_length_ > file_bytes - snapshot_bytes_ - sizeof(record)){
+            throw std::runtime_error("PlaylistJournal: " + snapshot_path_ + " is damaged");
+        }
+        std::string song(record.song_length_, '\0');
+        std::string artist(record.artist_length_, '\0');
+        //the snapshot was synced before it was renamed into place, so unlike the log a bad record is real damage
+        if(!in.read(song.data(), song.size()) || !in.read(artist.data(), artist.size())
+            || record.checksum_ != checksumOf(record, song, artist) || record.type_ != static_cast<uint32_t>(RecordType::Add)
+            || record.count_ == 0 || (!songs.empty() && std::make_pair(song, artist) <= songs.back())){
+            throw std::runtime_error("PlaylistJournal: " + snapshot_path_ + " is damaged");
+        }
+        if(record.count_ > 1){
+            repeats.emplace_back(songs.size(), record.count_ - 1);
+        }
+        songs.emplace_back(std::move(song), std::move(artist));
+        snapshot_bytes_ += sizeof(record) + record.song_length_ + record.artist_length_;
+    }
+    if(in.gcount() != 0){
+        throw std::runtime_error("PlaylistJournal: " + snapshot_path_ + " is damaged");
+    }
+    playlist_ = Playlist::fromSorted(songs);
+    for(const auto& repeat : repeats){
+        playlist_.add(songs[repeat.first].first, songs[repeat.first].second, repeat.second);
+    }
+}
+
+void PlaylistJournal::recoverLog(){
+    std::ifstream in(log_path_, std::ios::binary);
+    FileHeader header{};
+    bool usable = in && in.read(reinterpret_cast<char*>(&header), sizeof(header))
+        && std::memcmp(header.magic_, kMagic, sizeof(kMagic)) == 0 && header.generation_ >= generation_;
+    if(!usable){
+        //no log yet, a log cut short before its header was complete, or one that the snapshot already holds
+        in.close();
+        startLog(generation_);
+        return;
+    }
+    generation_ = header.generation_;
+
+    //replay up to the first record that is cut short or fails its checksum, everything after it was never committed
+    size_t good_bytes = sizeof(header);
+    size_t file_bytes = fileSize(log_path_);
+    RecordHeader record{};
+    std::string song;
+    std::string artist;
+    while(in.read(reinterpret_cast<char*>(&record), sizeof(record))){
+        //a torn length must not make the replay allocate gigabytes before the checksum catches it
+        if(static_cast<uint64_t>(record.song_length_) + record.artist_length_ > file_bytes - good_bytes - sizeof(record)){
+            break;
+        }
+        song.resize(record.song_length_);
+        artist.resize(record.artist_length_);
+        if(!in.read(song.data(), song.size()) || !in.read(artist.data(), artist.size())
+            || record.checksum_ != checksumOf(record, song, artist)){
+            break;
+        }
+        if(record.type_ == static_cast<uint32_t>(RecordType::Add)){
+            playlist_.add(song, artist, record.count_);
+        }
+        else if(record.type_ == static_cast<uint32_t>(RecordType::Remove)){
+            playlist_.remove(song, artist);
+        }
+        else if(record.type_ == static_cast<uint32_t>(RecordType::Clear)){
+            playlist_.clear();
+        }
+        else{
+            break;
+        }
+        good_bytes += sizeof(record) + song.size() + artist.size();
+    }
+    in.close();
+
+    log_fd_ = ::open(log_path_.c_str(), O_WRONLY | O_APPEND);
+    if(log_fd_ < 0 || ::ftruncate(log_fd_, static_cast<off_t>(good_bytes)) != 0 || ::fsync(log_fd_) != 0){
+        throw std::runtime_error("PlaylistJournal: cannot reopen " + log_path_);
+    }
+    log_bytes_ = good_bytes;
+}
+
+void PlaylistJournal::startLog(uint64_t generation){
+    FileHeader header{};
+    std::memcpy(header.magic_, kMagic, sizeof(kMagic));
+    header.generation_ = generation;
+    //the new log is written aside and renamed over the old one, so there is always a whole log in place
+    std::string temporary_path = log_path_ + ".tmp";
+    int fd = ::open(temporary_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_APPEND, 0644);
+    if(fd < 0){
+        throw std::runtime_error("PlaylistJournal: cannot open " + temporary_path);
+    }
+    try{
+        writeAll(fd, std::string_view(reinterpret_cast<const char*>(&header), sizeof(header)), temporary_path);
+        if(::fsync(fd) != 0 || ::rename(temporary_path.c_str(), log_path_.c_str()) != 0){
+            throw std::runtime_error("PlaylistJournal: cannot replace " + log_path_);
+        }
+        syncDirectory();
+    }
+    catch(...){
+        ::close(fd);
+        ::unlink(temporary_path.c_str());
+        throw;
+    }
+    if(log_fd_ >= 0){
+        ::close(log_fd_);
+    }
+    log_fd_ = fd;
+    log_bytes_ = sizeof(header);
+    generation_ = generation;
+}
+
+void PlaylistJournal::checkUsable() const{
+    if(broken_){
+        throw std::runtime_error("PlaylistJournal: " + log_path_ + " can take no more changes after a failed write, reopen the journal");
+    }
+}
+
+void PlaylistJournal::writeAll(int fd, std::string_view data, const std::string& path){
+    while(!data.empty()){
+        ssize_t written = ::write(fd, data.data(), data.size());
+        if(written < 0){
+            if(errno == EINTR){
+                continue;
+            }
+            throw std::runtime_error("PlaylistJournal: cannot write " + path);
+        }
+        data.remove_prefix(static_cast<size_t>(written));
+    }
+}
+
+size_t PlaylistJournal::fileSize(const std::string& path){
+    struct stat file_stat;
+    if(::stat(path.c_str(), &file_stat) != 0){
+        throw std::runtime_error("PlaylistJournal: cannot read the size of " + path);
+    }
+    return static_cast<size_t>(file_stat.st_size);
+}
+
+void PlaylistJournal::syncDirectory() const{
+    int fd = ::open(directory_.c_str(), O_RDONLY);
+    if(fd < 0){
+        throw std::runtime_error("PlaylistJournal: cannot open " + directory_);
+    }
+    int result = ::fsync(fd);
+    ::close(fd);
+    if(result != 0){
+        throw std::runtime_error("PlaylistJournal: cannot sync " + directory_);
+    }
+}
@@ -0,0 +1,251 @@
+/**
+ * @file PlaylistJournal.hpp
+ * @brief This is the interface of a Playlist that survives restarts by logging every change before it is acknowledged
+ * @version 0.1
+ * @date 2024-07-14
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+
+#ifndef PLAYLIST_JOURNAL_H_
+#define PLAYLIST_JOURNAL_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+#include "Playlist.hpp"
+
+/**
+ * @brief When the journal asks the operating system to put logged changes on disk
+ */
+enum class SyncPolicy {
+    None, /** Groups are written to the file but never synced, a crash of the process loses nothing but a power cut can */
+    Group, /** Every group commit is synced once, so the cost of a sync is shared by all the changes in the group */
+    Always /** Every change is written and synced before add, remove or clear returns */
+};
+
+/**
+ * @brief Settings for a PlaylistJournal
+ */
+struct JournalOptions {
+    SyncPolicy sync_ = SyncPolicy::Group; /** When logged changes are synced */
+    size_t group_size_ = 256; /** Changes collected in memory before they are written out together */
+    size_t compact_after_bytes_ = 64 << 20; /** Log size that triggers a snapshot, 0 to only compact when asked */
+};
+
+/**
+ * @brief A Playlist kept in a directory as a snapshot plus an append only log of the changes made since.
+ *
+ * add, remove and clear change the Playlist in memory and append a record to a buffer. The buffer is written to the
+ * log with one write, and synced once if the policy asks for it, when it holds group_size_ changes or when commit is
+ * called, so a burst of changes pays for one sync instead of one each. Changes still in the buffer are lost if the
+ * process dies; commit returns once they are as durable as the policy makes them.
+ *
+ * Once the log outgrows both compact_after_bytes_ and the last snapshot, the whole Playlist is written to a new
+ * snapshot with one record per song and its count, and the log starts over. Opening a journal loads the snapshot and
+ * replays the log on top of it. Each record carries a checksum, so a record torn by a crash ends the replay and is cut
+ * off. The snapshot and the log both carry a generation number: a log older than the snapshot was already folded into
+ * it, which is what a crash between writing a snapshot and starting the new log leaves behind, and it is skipped.
+ *
+ * The directory holds playlist.snapshot and playlist.log. Numbers are stored in the byte order of the machine that
+ * wrote them, like PlaylistImage. A journal is not thread safe, and only one journal may use a directory at a time.
+ */
+class PlaylistJournal {
+    public:
+        /**
+         * @brief Constructor that opens a journal directory, creating it if needed, and recovers its Playlist
+         * @param directory The directory holding the snapshot and the log
+         * @param options When to sync and when to compact
+         * @throw std::runtime_error if the directory or its files cannot be used, or the snapshot is damaged
+         */
+        explicit PlaylistJournal(const std::string& directory, const JournalOptions& options = JournalOptions());
+
+        PlaylistJournal(const PlaylistJournal&) = delete;
+        PlaylistJournal& operator=(const PlaylistJournal&) = delete;
+
+        /**
+         * @brief Destructor for PlaylistJournal, commits the changes still in the buffer
+         */
+        ~PlaylistJournal();
+
+        /**
+         * @brief Add a song to the Playlist and log the change
+         * @param song The name of the song to be added
+         * @param artist The name of the artist of the song
+         * @param count How many times to add the song
+         * @return True if the song was successfully added, otherwise false and nothing is logged
+         * @throw std::runtime_error if the log cannot be written, or the journal broke on an earlier failure
+         */
+        bool add(std::string_view song, std::string_view artist, size_t count = 1);
+
+        /**
+         * @brief Remove a song from the Playlist and log the change
+         * @param song The name of the song to be removed
+         * @param artist The name of the artist of the song
+         * @return True if the song was successfully removed, otherwise false and nothing is logged
+         * @throw std::runtime_error if the log cannot be written, or the journal broke on an earlier failure
+         */
+        bool remove(std::string_view song, std::string_view artist);
+
+        /**
+         * @brief Clear the Playlist of all songs and log the change
+         * @throw std::runtime_error if the log cannot be written, or the journal broke on an earlier failure
+         */
+        void clear();
+
+        /**
+         * @brief Write the buffered changes to the log in one write and sync them unless the policy is None. If that
+         * fails the log is cut back to the last commit and the changes stay buffered, so commit can be called again
+         * @throw std::runtime_error if the log cannot be written, or the journal broke on an earlier failure
+         */
+        void commit();
+
+        /**
+         * @brief Commit, write the whole Playlist to a new snapshot and start an empty log. If the new log cannot be started
+         * once the snapshot is in place, the journal breaks and has to be reopened
+         * @throw std::runtime_error if the snapshot or the new log cannot be written
+         */
+        void compact();
+
+        /**
+         * @brief Get the Playlist as of the last change, committed or not
+         * @return The Playlist, which must only be changed through the journal
+         */
+        const Playlist& playlist() const;
+
+        /**
+         * @brief Get the size of the log on disk, not counting the buffered changes
+         * @return Number of bytes in the log
+         */
+        size_t logBytes() const;
+
+        /**
+         * @brief Get the generation of the current snapshot and log, which goes up by one with every compaction
+         * @return The generation number
+         */
+        uint64_t generation() const;
+
+    private:
+        /**
+         * @brief What a log record does to the Playlist
+         */
+        enum class RecordType : uint32_t {
+            Add = 1,
+            Remove = 2,
+            Clear = 3
+        };
+
+        /**
+         * @brief Fixed size start of the snapshot and the log
+         */
+        struct FileHeader {
+            char magic_[8]; /** Always kMagic */
+            uint64_t generation_; /** Generation of the snapshot, or of the snapshot the log applies on top of */
+        };
+
+        /**
+         * @brief Fixed size start of every record, followed by the song and the artist
+         */
+        struct RecordHeader {
+            uint64_t checksum_; /** FNV-1a of the rest of the record, a torn or half written record fails it */
+            uint64_t count_; /** How many times the song is added, only used by Add */
+            uint32_t song_length_; /** Number of bytes in the song name */
+            uint32_t artist_length_; /** Number of bytes in the artist name */
+            uint32_t type_; /** The RecordType */
+            uint32_t padding_; /** Always 0 */
+        };
+
+        static constexpr char kMagic[8] = {'P', 'L', 'S', 'T', 'J', 'R', 'N', '1'}; /** Marks a journal file, the last byte is the format version */
+        static constexpr size_t kSnapshotBufferSize = 1 << 20; /** Bytes of snapshot records collected before each write */
+
+        /**
+         * @brief Encode a record at the end of a buffer
+         * @param type What the record does
+         * @param song The name of the song, empty for Clear
+         * @param artist The name of the artist, empty for Clear
+         * @param count How many times the song is added
+         * @param out The buffer to append to
+         */
+        static void appendRecord(RecordType type, std::string_view song, std::string_view artist, uint64_t count, std::string& out);
+
+        /**
+         * @brief Checksum a record
+         * @param header The record header, its checksum_ is not read
+         * @param song The name of the song
+         * @param artist The name of the artist
+         * @return The FNV-1a hash of the header past the checksum and the two names
+         */
+        static uint64_t checksumOf(const RecordHeader& header, std::string_view song, std::string_view artist);
+
+        /**
+         * @brief Buffer a record for the next group commit, committing once the group is full or the policy is Always
+         * @param type What the record does
+         * @param song The name of the song
+         * @param artist The name of the artist
+         * @param count How many times the song is added
+         */
+        void log(RecordType type, std::string_view song, std::string_view artist, uint64_t count);
+
+        /**
+         * @brief Load the snapshot into the Playlist, if there is one
+         * @throw std::runtime_error if the snapshot is damaged
+         */
+        void loadSnapshot();
+
+        /**
+         * @brief Replay the log on top of the snapshot, cut off a torn tail and open the log for appending. A missing log
+         * or one older than the snapshot is replaced by an empty log
+         */
+        void recoverLog();
+
+        /**
+         * @brief Replace the log with an empty one through a temporary file, so there is always a whole log in place
+         * @param generation The generation of the new log
+         */
+        void startLog(uint64_t generation);
+
+        /**
+         * @brief Refuse to go on once a failed commit could not be cut back out of the log, or a compaction left the log
+         * behind the snapshot
+         * @throw std::runtime_error if the journal is broken
+         */
+        void checkUsable() const;
+
+        /**
+         * @brief Write every byte of a buffer to a file, retrying short writes
+         * @param fd The file to write to
+         * @param data The bytes to write
+         * @param path The name of the file, for the error message
+         */
+        static void writeAll(int fd, std::string_view data, const std::string& path);
+
+        /**
+         * @brief Get the size of a file
+         * @param path The file
+         * @return Number of bytes in the file
+         */
+        static size_t fileSize(const std::string& path);
+
+        /**
+         * @brief Sync the directory so renames and new files in it survive a crash
+         */
+        void syncDirectory() const;
+
+        std::string directory_; /** The directory holding the snapshot and the log */
+        std::string snapshot_path_; /** Path of playlist.snapshot */
+        std::string log_path_; /** Path of playlist.log */
+        JournalOptions options_; /** When to sync and when to compact */
+        Playlist playlist_; /** The Playlist as of the last change */
+        std::string pending_; /** Encoded records not yet written to the log */
+        size_t pending_records_; /** Number of records in pending_ */
+        int log_fd_; /** The log, open for appending */
+        size_t log_bytes_; /** Bytes in the log on disk */
+        size_t snapshot_bytes_; /** Bytes in the last snapshot, the log must outgrow it before it is compacted */
+        uint64_t generation_; /** Generation of the snapshot and the log */
+        bool broken_; /** Set when the log may end in part of a failed commit or is older than the snapshot, every later change or commit throws */
+};
+
+#endif//PLAYLIST_JOURNAL_H_
@@ -0,0 +1,169 @@
+/**
+ * @file PlaylistStats.cpp
+ * @brief This is the implementation file of the PlaylistStats interface
+ * @version 0.1
+ * @date 2024-07-14
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+#include "PlaylistStats.hpp"
+
+#include <cmath>
+#include <sstream>
+
+namespace {
+
+const char* const kOperationNames[kTracedOperations] = {"search", "add", "remove"}; /** Indexed by TracedOperation */
+
+/**
+ * @brief Divide for an average, 0 when nothing was counted
+ */
+double average(uint64_t total, uint64_t calls){
+    return calls == 0 ? 0.0 : static_cast<double>(total) / calls;
+}
+
+}
+
+uint64_t OperationStats::latencyPercentile(double fraction) const{
+    if(sampled_calls_ == 0){
+        return 0;
+    }
+    //the first bucket that takes the running count past the wanted rank holds the percentile
+    uint64_t rank = static_cast<uint64_t>(std::ceil(fraction * sampled_calls_));
+    uint64_t seen = 0;
+    for(size_t i = 0; i < kLatencyBuckets; i++){
+        seen += latency_ns_[i];
+        if(seen >= rank && seen > 0){
+            return uint64_t(2) << i;
+        }
+    }
+    return uint64_t(2) << (kLatencyBuckets - 1);
+}
+
+const OperationStats& PlaylistStatsSnapshot::operation(TracedOperation operation) const{
+    return operations_[static_cast<size_t>(operation)];
+}
+
+std::string PlaylistStatsSnapshot::toText() const{
+    std::ostringstream out;
+    out << "instrumentation: " << (enabled_ ? "on" : "off") << '\n';
+    out << "songs: " << songs_ << '\n';
+    out << "height: " << height_ << '\n';
+    out << "live nodes: " << live_nodes_ << '\n';
+    out << "node bytes: " << node_bytes_ << '\n';
+    out << "string bytes: " << string_bytes_ << '\n';
+    out << "index bytes: " << index_bytes_ << '\n';
+    if(!enabled_){
+        return out.str();
+    }
+    out << "nodes allocated: " << nodes_allocated_ << '\n';
+    out << "nodes freed: " << nodes_freed_ << '\n';
+    for(size_t i = 0; i < kTracedOperations; i++){
+        const OperationStats& stats = operations_[i];
+        out << kOperationNames[i] << ": calls " << stats.calls_
+            << ", nodes/call " << average(stats.nodes_visited_, stats.calls_)
+            << ", comparisons/call " << average(stats.key_comparisons_, stats.calls_)
+            << ", key bytes/call " << average(stats.key_bytes_, stats.calls_)
+            << ", p50 <= " << stats.latencyPercentile(0.5) << " ns"
+            << ", p99 <= " << stats.latencyPercentile(0.99) << " ns"
+            << ", p999 <= " << stats.latencyPercentile(0.999) << " ns"
+            << " (" << stats.sampled_calls_ << " sampled)\n";
+    }
+    return out.str();
+}
+
+std::string PlaylistStatsSnapshot::toJson() const{
+    std::ostringstream out;
+    out << "{\"enabled\":" << (enabled_ ? "true" : "false")
+        << ",\"songs\":" << songs_
+        << ",\"height\":" << height_
+        << ",\"live_nodes\":" << live_nodes_
+        << ",\"node_bytes\":" << node_bytes_
+        << ",\"string_bytes\":" << string_bytes_
+        << ",\"index_bytes\":" << index_bytes_
+        << ",\"nodes_allocated\":" << nodes_allocated_
+        << ",\"nodes_freed\":" << nodes_freed_
+        << ",\"operations\":{";
+    for(size_t i = 0; i < kTracedOperations; i++){
+        const OperationStats& stats = operations_[i];
+        out << (i == 0 ? "" : ",") << '"' << kOperationNames[i] << "\":{"
+            << "\"calls\":" << stats.calls_
+            << ",\"nodes_visited\":" << stats.nodes_visited_
+            << ",\"key_comparisons\":" << stats.key_comparisons_
+            << ",\"key_bytes\":" << stats.key_bytes_
+            << ",\"sampled_calls\":" << stats.sampled_calls_
+            << ",\"p50_ns\":" << stats.latencyPercentile(0.5)
+            << ",\"p99_ns\":" << stats.latencyPercentile(0.99)
+            << ",\"p999_ns\":" << stats.latencyPercentile(0.999)
+            << ",\"latency_ns_log2_buckets\":[";
+        for(size_t bucket = 0; bucket < kLatencyBuckets; bucket++){
+            out << (bucket == 0 ? "" : ",") << stats.latency_ns_[bucket];
+        }
+        out << "]}";
+    }
+    out << "}}";
+    return out.str();
+}
+
+PlaylistStats::Scope::Scope(PlaylistStats& stats, TracedOperation operation, size_t key_bytes) :
+    stats_(stats), operation_(operation), key_bytes_(key_bytes),
+    nodes_visited_before_(trace_.nodes_visited_), key_comparisons_before_(trace_.key_comparisons_), sampled_(false){
+    if(trace_.calls_until_sample_ == 0){
+        trace_.calls_until_sample_ = kSampleEvery;
+        sampled_ = true;
+        start_ = std::chrono::steady_clock::now();
+    }
+    trace_.calls_until_sample_--;
+}
+
+PlaylistStats::Scope::~Scope(){
+    Counters& counters = stats_.operations_[static_cast<size_t>(operation_)];
+    if(sampled_){
+        auto elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start_).count();
+        //bucket i holds [2^i, 2^(i + 1)) ns, with 0 and 1 ns both in bucket 0
+        size_t bucket = 0;
+        for(uint64_t ns = static_cast<uint64_t>(elapsed) >> 1; ns != 0 && bucket + 1 < kLatencyBuckets; ns >>= 1){
+            bucket++;
+        }
+        bump(counters.latency_ns_[bucket], 1);
+        bump(counters.sampled_calls_, 1);
+    }
+    bump(counters.calls_, 1);
+    bump(counters.nodes_visited_, trace_.nodes_visited_ - nodes_visited_before_);
+    bump(counters.key_comparisons_, trace_.key_comparisons_ - key_comparisons_before_);
+    bump(counters.key_bytes_, key_bytes_);
+}
+
+void PlaylistStats::fill(PlaylistStatsSnapshot& snapshot) const{
+    snapshot.enabled_ = true;
+    snapshot.nodes_allocated_ = nodes_allocated_.load(std::memory_order_relaxed);
+    snapshot.nodes_freed_ = nodes_freed_.load(std::memory_order_relaxed);
+    for(size_t i = 0; i < kTracedOperations; i++){
+        const Counters& counters = operations_[i];
+        OperationStats& stats = snapshot.operations_[i];
+        stats.calls_ = counters.calls_.load(std::memory_order_relaxed);
+        stats.nodes_visited_ = counters.nodes_visited_.load(std::memory_order_relaxed);
+        stats.key_comparisons_ = counters.key_comparisons_.load(std::memory_order_relaxed);
+        stats.key_bytes_ = counters.key_bytes_.load(std::memory_order_relaxed);
+        stats.sampled_calls_ = counters.sampled_calls_.load(std::memory_order_relaxed);
+        for(size_t bucket = 0; bucket < kLatencyBuckets; bucket++){
+            stats.latency_ns_[bucket] = counters.latency_ns_[bucket].load(std::memory_order_relaxed);
+        }
+    }
+}
+
+void PlaylistStats::reset(){
+    nodes_allocated_.store(0, std::memory_order_relaxed);
+    nodes_freed_.store(0, std::memory_order_relaxed);
+    for(Counters& counters : operations_){
+        counters.calls_.store(0, std::memory_order_relaxed);
+        counters.nodes_visited_.store(0, std::memory_order_relaxed);
+        counters.key_comparisons_.store(0, std::memory_order_relaxed);
+        counters.key_bytes_.store(0, std::memory_order_relaxed);
+        counters.sampled_calls_.store(0, std::memory_order_relaxed);
+        for(auto& bucket : counters.latency_ns_){
+            bucket.store(0, std::memory_order_relaxed);
+        }
+    }
+}
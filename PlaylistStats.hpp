@@ -0,0 +1,233 @@
+/**
+ * @file PlaylistStats.hpp
+ * @brief This is the interface of the counters and latency histograms a Playlist keeps when built with instrumentation
+ * @version 0.1
+ * @date 2024-07-14
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+
+#ifndef PLAYLIST_STATS_H_
+#define PLAYLIST_STATS_H_
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+/**
+ * PLAYLIST_TRACE(statement) runs statement only in builds with PLAYLIST_INSTRUMENTATION defined, and compiles to
+ * nothing otherwise, so the hot paths pay nothing unless instrumentation was asked for at build time.
+ */
+#ifdef PLAYLIST_INSTRUMENTATION
+#define PLAYLIST_TRACE(...) __VA_ARGS__
+#else
+#define PLAYLIST_TRACE(...)
+#endif
+
+/**
+ * @brief The Playlist operations that are counted and timed
+ */
+enum class TracedOperation {
+    Search,
+    Add,
+    Remove
+};
+
+constexpr size_t kTracedOperations = 3; /** Number of values in TracedOperation */
+constexpr size_t kLatencyBuckets = 40; /** Bucket i of a histogram counts latencies below 2^(i + 1) ns, the last bucket anything slower */
+
+/**
+ * @brief What was recorded for one kind of operation
+ */
+struct OperationStats {
+    uint64_t calls_ = 0; /** Number of times the operation ran */
+    uint64_t nodes_visited_ = 0; /** Nodes stepped through by all the calls, including the ones rotations and removals relink */
+    uint64_t key_comparisons_ = 0; /** Song and artist keys compared by all the calls */
+    uint64_t key_bytes_ = 0; /** Bytes in the song and artist names passed to all the calls */
+    uint64_t sampled_calls_ = 0; /** Calls that were timed, the histogram holds one entry for each */
+    std::array<uint64_t, kLatencyBuckets> latency_ns_{}; /** Sampled latencies, bucket i below 2^(i + 1) ns */
+
+    /**
+     * @brief Estimate a latency percentile from the histogram
+     * @param fraction The percentile as a fraction, 0.5 for the median
+     * @return The upper bound in ns of the bucket holding the percentile, 0 if nothing was sampled
+     */
+    uint64_t latencyPercentile(double fraction) const;
+};
+
+/**
+ * @brief A copy of everything a Playlist recorded, taken by Playlist::stats
+ */
+struct PlaylistStatsSnapshot {
+    bool enabled_ = false; /** False if the build has no instrumentation, then only the shape and memory fields are filled */
+    size_t songs_ = 0; /** Number of songs in the Playlist */
+    size_t height_ = 0; /** Height of the tree */
+    size_t live_nodes_ = 0; /** Nodes alive in the node pool, which copies of the Playlist share */
+    size_t node_bytes_ = 0; /** Bytes reserved by the node pool */
+    size_t string_bytes_ = 0; /** Bytes of names stored in the string pool, which only holds names too long for a node */
+    size_t index_bytes_ = 0; /** Bytes reserved by the node pool of the artist index, 0 without an index */
+    uint64_t nodes_allocated_ = 0; /** Nodes made for new songs and for private copies of shared nodes */
+    uint64_t nodes_freed_ = 0; /** Nodes given back by removes */
+    std::array<OperationStats, kTracedOperations> operations_{}; /** Indexed by TracedOperation */
+
+    /**
+     * @brief Get what was recorded for one kind of operation
+     * @param operation The operation
+     * @return Its counters and histogram
+     */
+    const OperationStats& operation(TracedOperation operation) const;
+
+    /**
+     * @brief Format the snapshot as lines of name: value for logs and consoles
+     * @return The text, one field per line with averages and p50, p99 and p999 latencies per operation
+     */
+    std::string toText() const;
+
+    /**
+     * @brief Format the snapshot as a JSON object for metrics pipelines
+     * @return The JSON text with every field, histograms as arrays of bucket counts
+     */
+    std::string toJson() const;
+};
+
+/**
+ * @brief The counters a Playlist updates as it works, only part of a Playlist in builds with PLAYLIST_INSTRUMENTATION.
+ *
+ * Work done inside an operation, like nodes visited, is tallied in a per thread trace so the recursive helpers only
+ * bump a thread local. A Scope around each public operation adds what its trace gathered to the totals when it ends.
+ * One call in kSampleEvery per thread is timed, which keeps reading the clock off almost every call.
+ *
+ * Totals are relaxed atomics updated with fetch_add, so readers searching the same Playlist from several threads at
+ * once, as ConcurrentPlaylist does under a shared lock, never lose counts to each other.
+ */
+class PlaylistStats {
+    public:
+        /**
+         * @brief Times one call of an operation and adds the work it did to the totals when it goes out of scope
+         */
+        class Scope {
+            public:
+                /**
+                 * @brief Start counting an operation
+                 * @param stats The stats of the Playlist running the operation
+                 * @param operation Which operation this is
+                 * @param key_bytes Bytes in the names passed to the operation
+                 */
+                Scope(PlaylistStats& stats, TracedOperation operation, size_t key_bytes);
+
+                Scope(const Scope&) = delete;
+                Scope& operator=(const Scope&) = delete;
+
+                /**
+                 * @brief Destructor for Scope, adds the call to the totals
+                 */
+                ~Scope();
+
+            private:
+                PlaylistStats& stats_; /** The stats the call is added to */
+                TracedOperation operation_; /** Which operation is running */
+                size_t key_bytes_; /** Bytes in the names passed to the operation */
+                uint64_t nodes_visited_before_; /** The trace when the call started, nested calls are counted by both */
+                uint64_t key_comparisons_before_; /** The trace when the call started */
+                bool sampled_; /** True if this call is timed */
+                std::chrono::steady_clock::time_point start_; /** When the call started, only set if sampled_ */
+        };
+
+        PlaylistStats() = default;
+
+        /**
+         * @brief Copy constructor for PlaylistStats, a copy of a Playlist starts counting from zero
+         */
+        PlaylistStats(const PlaylistStats&) {}
+
+        /**
+         * @brief Copy assignment operator for PlaylistStats, keeps the counts of the assigned to Playlist
+         * @return Reference to this PlaylistStats
+         */
+        PlaylistStats& operator=(const PlaylistStats&) { return *this; }
+
+        /**
+         * @brief Count a node visited together with a key comparison, called once per step down the tree
+         */
+        static void countStep() {
+            trace_.nodes_visited_++;
+            trace_.key_comparisons_++;
+        }
+
+        /**
+         * @brief Count a node visited without a key comparison, like the steps to the leftmost node of a subtree
+         */
+        static void countVisit() {
+            trace_.nodes_visited_++;
+        }
+
+        /**
+         * @brief Count a node made for a new song or for a private copy of a shared node
+         */
+        void countAllocation() {
+            bump(nodes_allocated_, 1);
+        }
+
+        /**
+         * @brief Count a node given back to the pool
+         */
+        void countFree() {
+            bump(nodes_freed_, 1);
+        }
+
+        /**
+         * @brief Copy the totals into a snapshot
+         * @param snapshot The snapshot to fill, its shape and memory fields are left as they are
+         */
+        void fill(PlaylistStatsSnapshot& snapshot) const;
+
+        /**
+         * @brief Set every total back to zero
+         */
+        void reset();
+
+    private:
+        /**
+         * @brief Work done by the operations running on one thread, only ever growing
+         */
+        struct Trace {
+            uint64_t nodes_visited_;
+            uint64_t key_comparisons_;
+            uint32_t calls_until_sample_;
+        };
+
+        /**
+         * @brief Running totals for one kind of operation
+         */
+        struct Counters {
+            std::atomic<uint64_t> calls_{0};
+            std::atomic<uint64_t> nodes_visited_{0};
+            std::atomic<uint64_t> key_comparisons_{0};
+            std::atomic<uint64_t> key_bytes_{0};
+            std::atomic<uint64_t> sampled_calls_{0};
+            std::array<std::atomic<uint64_t>, kLatencyBuckets> latency_ns_{};
+        };
+
+        static constexpr uint32_t kSampleEvery = 64; /** One call in this many per thread is timed */
+
+        /**
+         * @brief Add to a total, see the class comment
+         * @param total The total to add to
+         * @param amount How much to add
+         */
+        static void bump(std::atomic<uint64_t>& total, uint64_t amount) {
+            total.fetch_add(amount, std::memory_order_relaxed);
+        }
+
+        static inline thread_local Trace trace_{0, 0, 0}; /** Work done on this thread so far */
+
+        std::array<Counters, kTracedOperations> operations_; /** Indexed by TracedOperation */
+        std::atomic<uint64_t> nodes_allocated_{0}; /** Nodes made */
+        std::atomic<uint64_t> nodes_freed_{0}; /** Nodes given back */
+};
+
+#endif//PLAYLIST_STATS_H_
@@ -0,0 +1,1264 @@
+/**
+ * @file PlaylistTests.cpp
+ * @brief Unit tests for Playlist and the classes built around it, checked against std::multiset as a reference
+ * @version 0.1
+ * @date 2024-07-14
+ * 
+ * @copyright Copyright (c) 2024
+ * 
+ */
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iterator>
+#include <map>
+#include <new>
+#include <random>
+#include <set>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include <dirent.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "ConcurrentPlaylist.hpp"
+#include "FlatPlaylist.hpp"
+#include "Playlist.hpp"
+#include "PlaylistCsv.hpp"
+#include "PlaylistImage.hpp"
+#include "PlaylistJournal.hpp"
+#include "PlaylistStats.hpp"
+#include "StringPool.hpp"
+#include "ThreadPool.hpp"
+
+namespace {
+
+std::atomic<size_t> allocation_count{0}; /** Calls to operator new since the program started */
+
+}
+
+//every allocation in the test program goes through these, so a test can check that a call makes none
+void* operator new(size_t size){
+    allocation_count.fetch_add(1, std::memory_order_relaxed);
+    if(void* memory = std::malloc(size == 0 ? 1 : size)){
+        return memory;
+    }
+    throw std::bad_alloc();
+}
+
+void* operator new[](size_t size){
+    return operator new(size);
+}
+
+void operator delete(void* memory) noexcept{
+    std::free(memory);
+}
+
+void operator delete[](void* memory) noexcept{
+    std::free(memory);
+}
+
+void operator delete(void* memory, size_t) noexcept{
+    std::free(memory);
+}
+
+void operator delete[](void* memory, size_t) noexcept{
+    std::free(memory);
+}
+
+//types aligned past what malloc guarantees, such as SongNode, come through the aligned forms and are counted the same way
+void* operator new(size_t size, std::align_val_t alignment){
+    allocation_count.fetch_add(1, std::memory_order_relaxed);
+    size_t align = static_cast<size_t>(alignment);
+    //aligned_alloc wants the size to be a multiple of the alignment
+    size_t rounded = size == 0 ? align : (size + align - 1) / align * align;
+    if(void* memory = std::aligned_alloc(align, rounded)){
+        return memory;
+    }
+    throw std::bad_alloc();
+}
+
+void* operator new[](size_t size, std::align_val_t alignment){
+    return operator new(size, alignment);
+}
+
+void operator delete(void* memory, std::align_val_t) noexcept{
+    std::free(memory);
+}
+
+void operator delete[](void* memory, std::align_val_t) noexcept{
+    std::free(memory);
+}
+
+void operator delete(void* memory, size_t, std::align_val_t) noexcept{
+    std::free(memory);
+}
+
+void operator delete[](void* memory, size_t, std::align_val_t) noexcept{
+    std::free(memory);
+}
+
+namespace {
+
+using Song = std::pair<std::string, std::string>;
+using Songs = std::vector<Song>;
+
+Song songOf(const SongNode& song){
+    return Song(song.song(), song.artist());
+}
+
+Song songOf(const SongKey& song){
+    return Song(song.song_, song.artist_);
+}
+
+Song songOf(const SongEntry& song){
+    return Song(song.song_, song.artist_);
+}
+
+/**
+ * @brief Copy the songs of anything that iterates SongNodes or SongKeys into plain pairs
+ */
+template <typename Range>
+Songs songsOf(const Range& songs){
+    Songs copied;
+    for(const auto& song : songs){
+        copied.push_back(songOf(song));
+    }
+    return copied;
+}
+
+/**
+ * @brief The distinct songs of a reference multiset, which is what a Playlist holds once repeats are counted
+ */
+Songs songsOf(const std::multiset<Song>& songs){
+    Songs distinct(songs.begin(), songs.end());
+    distinct.erase(std::unique(distinct.begin(), distinct.end()), distinct.end());
+    return distinct;
+}
+
+/**
+ * @brief How many times each song of a Playlist was added
+ */
+std::map<Song, size_t> countsOf(const Playlist& playlist){
+    std::map<Song, size_t> counts;
+    for(const SongNode& song : playlist){
+        counts[{std::string(song.song()), std::string(song.artist())}] = song.count_;
+    }
+    return counts;
+}
+
+std::map<Song, size_t> countsOf(const std::multiset<Song>& songs){
+    std::map<Song, size_t> counts;
+    for(const Song& song : songs){
+        counts[song]++;
+    }
+    return counts;
+}
+
+/**
+ * @brief Check the AVL height bound, 1.44 log2(n + 2)
+ */
+void expectBalanced(const Playlist& playlist){
+    EXPECT_LE(static_cast<double>(playlist.getHeight()), 1.44 * std::log2(playlist.getNumberOfSongs() + 2.0));
+}
+
+/**
+ * @brief Random songs from a small alphabet so repeats and shared prefixes are common
+ */
+class SongSource {
+    public:
+        explicit SongSource(unsigned seed) : rng_(seed) {}
+
+        Song next(){
+            return {"song " + std::to_string(rng_() % 400), "artist " + std::to_string(rng_() % 7)};
+        }
+
+        size_t below(size_t bound){
+            return rng_() % bound;
+        }
+
+    private:
+        std::mt19937 rng_;
+};
+
+}
+
+TEST(PlaylistTest, AddSearchRemove){
+    Playlist playlist;
+    EXPECT_TRUE(playlist.isEmpty());
+    EXPECT_TRUE(playlist.add("Humble", "Kendrick Lamar"));
+    EXPECT_TRUE(playlist.add("Espresso", "Sabrina Carpenter"));
+    EXPECT_FALSE(playlist.add("", "Frank Ocean"));
+    EXPECT_FALSE(playlist.add("Nights", ""));
+    EXPECT_EQ(playlist.getNumberOfSongs(), 2u);
+    EXPECT_TRUE(playlist.search("Humble", "Kendrick Lamar"));
+    EXPECT_FALSE(playlist.search("Humble", "Sabrina Carpenter"));
+    EXPECT_TRUE(playlist.remove("Humble", "Kendrick Lamar"));
+    EXPECT_FALSE(playlist.remove("Humble", "Kendrick Lamar"));
+    EXPECT_FALSE(playlist.search("Humble", "Kendrick Lamar"));
+    playlist.clear();
+    EXPECT_TRUE(playlist.isEmpty());
+    EXPECT_EQ(playlist.getHeight(), 0u);
+}
+
+TEST(PlaylistTest, KeysCompareSongThenArtist){
+    Playlist playlist;
+    playlist.add("ab", "c");
+    playlist.add("a", "bc");
+    EXPECT_TRUE(playlist.search("ab", "c"));
+    EXPECT_TRUE(playlist.search("a", "bc"));
+    EXPECT_FALSE(playlist.search("abc", ""));
+    EXPECT_EQ(songsOf(playlist), (Songs{{"a", "bc"}, {"ab", "c"}}));
+}
+
+TEST(PlaylistTest, MatchesMultisetUnderRandomChanges){
+    SongSource source(1);
+    Playlist playlist;
+    std::multiset<Song> reference;
+    for(int step = 0; step < 20000; step++){
+        Song song = source.next();
+        //remove takes out every copy of the song at once
+        if(source.below(3) == 0){
+            bool removed = playlist.remove(song.first, song.second);
+            EXPECT_EQ(removed, reference.erase(song) > 0);
+        }
+        else{
+            playlist.add(song.first, song.second);
+            reference.insert(song);
+        }
+        EXPECT_EQ(playlist.search(song.first, song.second), reference.count(song) > 0);
+        EXPECT_EQ(playlist.getCount(song.first, song.second), reference.count(song));
+    }
+    EXPECT_EQ(songsOf(playlist), songsOf(reference));
+    EXPECT_EQ(countsOf(playlist), countsOf(reference));
+    EXPECT_EQ(playlist.getNumberOfSongs(), songsOf(reference).size());
+    expectBalanced(playlist);
+}
+
+TEST(PlaylistTest, SortedInsertsStayBalanced){
+    //sorted input is the worst case for an unbalanced tree, a million songs would make a chain a million deep
+    Playlist playlist;
+    char name[32];
+    for(int i = 0; i < 1000000; i++){
+        std::snprintf(name, sizeof(name), "song %08d", i);
+        playlist.add(name, "artist");
+    }
+    EXPECT_EQ(playlist.getNumberOfSongs(), 1000000u);
+    expectBalanced(playlist);
+}
+
+TEST(PlaylistTest, TraversalOrders){
+    Playlist playlist;
+    for(const char* song : {"d", "b", "f", "a", "c", "e", "g"}){
+        playlist.add(song, "x");
+    }
+    auto titles = [](const auto& songs){
+        std::string joined;
+        for(const auto& song : songs){
+            joined += songOf(song).first;
+        }
+        return joined;
+    };
+    EXPECT_EQ(titles(playlist.preorder()), "dbacfeg");
+    EXPECT_EQ(titles(playlist.inorder()), "abcdefg");
+    EXPECT_EQ(titles(playlist.postorder()), "acbegfd");
+    EXPECT_EQ(titles(playlist.preorderTraverse()), "dbacfeg");
+    EXPECT_EQ(titles(playlist.inorderTraverse()), "abcdefg");
+    EXPECT_EQ(titles(playlist.postorderTraverse()), "acbegfd");
+    EXPECT_EQ(titles(playlist), "abcdefg");
+}
+
+TEST(PlaylistTest, OrderStatistics){
+    SongSource source(2);
+    Playlist playlist;
+    std::multiset<Song> reference;
+    for(int i = 0; i < 2000; i++){
+        Song song = source.next();
+        playlist.add(song.first, song.second);
+        reference.insert(song);
+    }
+    Songs sorted = songsOf(reference);
+    for(size_t k = 0; k < sorted.size(); k += 37){
+        EXPECT_EQ(playlist.at(k).song(), sorted[k].first);
+        EXPECT_EQ(playlist.rankOf(sorted[k].first, sorted[k].second),
+            static_cast<size_t>(std::lower_bound(sorted.begin(), sorted.end(), sorted[k]) - sorted.begin()));
+    }
+    EXPECT_THROW(playlist.at(sorted.size()), std::out_of_range);
+    EXPECT_EQ(songsOf(playlist.range(100, 50)), Songs(sorted.begin() + 100, sorted.begin() + 150));
+    EXPECT_EQ(songsOf(playlist.range(sorted.size() - 3, 100)), Songs(sorted.end() - 3, sorted.end()));
+    EXPECT_TRUE(songsOf(playlist.range(sorted.size() + 5, 5)).empty());
+}
+
+TEST(PlaylistTest, AddBatchAndFromSorted){
+    SongSource source(3);
+    Playlist playlist;
+    std::multiset<Song> reference;
+    for(int round = 0; round < 20; round++){
+        Songs batch;
+        size_t size = source.below(round % 2 == 0 ? 500 : 5);
+        for(size_t i = 0; i < size; i++){
+            batch.push_back(source.next());
+        }
+        //the return value counts only songs that were not in the playlist yet, repeats just bump counts
+        std::set<Song> added;
+        for(const Song& song : batch){
+            if(reference.count(song) == 0){
+                added.insert(song);
+            }
+        }
+        batch.push_back({"", "empty song"});
+        EXPECT_EQ(playlist.addBatch(batch), added.size());
+        reference.insert(batch.begin(), batch.end() - 1);
+        EXPECT_EQ(countsOf(playlist), countsOf(reference));
+        expectBalanced(playlist);
+    }
+    //fromSorted counts repeated pairs like addBatch
+    Songs sorted(reference.begin(), reference.end());
+    Playlist built = Playlist::fromSorted(sorted);
+    EXPECT_EQ(countsOf(built), countsOf(reference));
+    expectBalanced(built);
+    std::reverse(sorted.begin(), sorted.end());
+    EXPECT_THROW(Playlist::fromSorted(sorted), std::invalid_argument);
+}
+
+TEST(PlaylistTest, PrefixAndRangeQueries){
+    Playlist playlist;
+    for(const char* song : {"a", "ab", "abc", "abd", "b", "ba", "c"}){
+        playlist.add(song, "x");
+    }
+    auto titles = [](SongRange songs){
+        std::string joined;
+        for(const SongNode& song : songs){
+            joined += std::string(song.song()) + " ";
+        }
+        return joined;
+    };
+    EXPECT_EQ(titles(playlist.findPrefix("ab")), "ab abc abd ");
+    EXPECT_EQ(titles(playlist.findPrefix("")), "a ab abc abd b ba c ");
+    EXPECT_EQ(titles(playlist.findPrefix("zz")), "");
+    EXPECT_EQ(titles(playlist.findRange("ab", "b")), "ab abc abd ");
+    EXPECT_EQ(titles(playlist.findRange("b", "ab")), "");
+}
+
+TEST(PlaylistTest, ArtistIndexFollowsChanges){
+    SongSource source(4);
+    Playlist playlist;
+    std::multiset<Song> reference;
+    for(int i = 0; i < 300; i++){
+        Song song = source.next();
+        playlist.add(song.first, song.second);
+        reference.insert(song);
+    }
+    EXPECT_THROW(playlist.findByArtist("artist 1"), std::logic_error);
+    EXPECT_EQ(playlist.stats().index_bytes_, 0u);
+    playlist.enableArtistIndex();
+    EXPECT_TRUE(playlist.hasArtistIndex());
+    EXPECT_GT(playlist.stats().index_bytes_, 0u);
+    for(int step = 0; step < 2000; step++){
+        Song song = source.next();
+        if(step % 3 == 0){
+            EXPECT_EQ(playlist.remove(song.first, song.second), reference.erase(song) > 0);
+        }
+        else if(step % 50 == 1){
+            Songs batch = {source.next(), source.next(), source.next()};
+            playlist.addBatch(batch);
+            reference.insert(batch.begin(), batch.end());
+        }
+        else{
+            playlist.add(song.first, song.second);
+            reference.insert(song);
+        }
+    }
+    for(int artist = 0; artist < 7; artist++){
+        std::string name = "artist " + std::to_string(artist);
+        Songs expected;
+        for(const Song& song : songsOf(reference)){
+            if(song.second == name){
+                expected.push_back(song);
+            }
+        }
+        Songs found = songsOf(playlist.findByArtist(name));
+        std::sort(expected.begin(), expected.end());
+        EXPECT_EQ(found, expected);
+    }
+    playlist.disableArtistIndex();
+    EXPECT_FALSE(playlist.hasArtistIndex());
+    EXPECT_EQ(playlist.stats().index_bytes_, 0u);
+}
+
+TEST(PlaylistTest, CopiesAreIndependentSnapshots){
+    SongSource source(5);
+    Playlist original;
+    std::multiset<Song> original_reference;
+    for(int i = 0; i < 500; i++){
+        Song song = source.next();
+        original.add(song.first, song.second);
+        original_reference.insert(song);
+    }
+    Playlist copy = original;
+    std::multiset<Song> copy_reference = original_reference;
+    for(int step = 0; step < 1000; step++){
+        Song song = source.next();
+        Playlist& changed = step % 2 == 0 ? original : copy;
+        std::multiset<Song>& reference = step % 2 == 0 ? original_reference : copy_reference;
+        if(step % 3 == 0){
+            EXPECT_EQ(changed.remove(song.first, song.second), reference.erase(song) > 0);
+        }
+        else if(step % 3 != 0){
+            changed.add(song.first, song.second);
+            reference.insert(song);
+        }
+    }
+    EXPECT_EQ(countsOf(original), countsOf(original_reference));
+    EXPECT_EQ(countsOf(copy), countsOf(copy_reference));
+
+    Playlist assigned;
+    assigned = copy;
+    copy.clear();
+    EXPECT_EQ(songsOf(assigned), songsOf(copy_reference));
+    Playlist moved = std::move(assigned);
+    EXPECT_EQ(countsOf(moved), countsOf(copy_reference));
+    expectBalanced(moved);
+}
+
+TEST(PlaylistTest, CountsAndTopSongs){
+    SongSource source(11);
+    Playlist playlist;
+    std::multiset<Song> reference;
+    Songs hot = {{"Nights", "Frank Ocean"}, {"Humble", "Kendrick Lamar"}, {"Espresso", "Sabrina Carpenter"}};
+    for(int i = 0; i < 5000; i++){
+        //a few hot songs are added over and over between many songs added only a handful of times
+        Song song = i % 4 == 0 ? hot[source.below(hot.size())] : source.next();
+        playlist.add(song.first, song.second);
+        reference.insert(song);
+    }
+    EXPECT_TRUE(playlist.add("Nights", "Frank Ocean", 1000));
+    EXPECT_FALSE(playlist.add("Nights", "Frank Ocean", 0));
+    for(int i = 0; i < 1000; i++){
+        reference.insert(hot[0]);
+    }
+    EXPECT_EQ(countsOf(playlist), countsOf(reference));
+    EXPECT_EQ(playlist.getCount("Nights", "Frank Ocean"), reference.count(hot[0]));
+    EXPECT_EQ(playlist.getCount("Nights", "Nobody"), 0u);
+
+    std::vector<size_t> expected;
+    for(const auto& entry : countsOf(reference)){
+        expected.push_back(entry.second);
+    }
+    std::sort(expected.rbegin(), expected.rend());
+    for(size_t k : {0u, 1u, 3u, 50u, 100000u}){
+        std::vector<SongEntry> top = playlist.topSongs(k);
+        ASSERT_EQ(top.size(), std::min(k, expected.size()));
+        for(size_t i = 0; i < top.size(); i++){
+            EXPECT_EQ(top[i].count_, expected[i]);
+            EXPECT_EQ(top[i].count_, reference.count(songOf(top[i])));
+        }
+    }
+    EXPECT_EQ(playlist.topSongs(1)[0].song_, "Nights");
+
+    //bumping a count on a copy leaves the original and its top songs alone
+    Playlist copy = playlist;
+    copy.add("Humble", "Kendrick Lamar", 100000);
+    EXPECT_EQ(copy.topSongs(1)[0].song_, "Humble");
+    EXPECT_EQ(playlist.topSongs(1)[0].song_, "Nights");
+    EXPECT_EQ(playlist.getCount("Humble", "Kendrick Lamar"), reference.count(hot[1]));
+    EXPECT_TRUE(Playlist().topSongs(5).empty());
+}
+
+TEST(PlaylistTest, CopiedSongsOutliveThePlaylist){
+    //a 60 character title is too long to live in a node, so a copy of the node would point into the string pool
+    std::string long_song(60, 'x');
+    std::vector<SongEntry> top;
+    std::vector<SongEntry> inorder;
+    std::vector<SongEntry> preorder;
+    std::vector<SongEntry> postorder;
+    {
+        Playlist playlist;
+        playlist.add(long_song, "Frank Ocean", 3);
+        playlist.add("Nights", "Frank Ocean");
+        top = playlist.topSongs(2);
+        inorder = playlist.inorderTraverse();
+        preorder = playlist.preorderTraverse();
+        postorder = playlist.postorderTraverse();
+    }
+    ASSERT_EQ(top.size(), 2u);
+    EXPECT_EQ(songOf(top[0]), Song(long_song, "Frank Ocean"));
+    EXPECT_EQ(top[0].count_, 3u);
+    EXPECT_EQ(songOf(top[1]), Song("Nights", "Frank Ocean"));
+    Songs expected = {{"Nights", "Frank Ocean"}, {long_song, "Frank Ocean"}};
+    EXPECT_EQ(songsOf(inorder), expected);
+    std::sort(preorder.begin(), preorder.end(), [](const SongEntry& a, const SongEntry& b){ return songOf(a) < songOf(b); });
+    EXPECT_EQ(songsOf(preorder), expected);
+    EXPECT_EQ(songsOf(postorder).size(), 2u);
+    EXPECT_EQ(postorder[0].count_ + postorder[1].count_, 4u);
+}
+
+TEST(PlaylistTest, SearchMany){
+    SongSource source(6);
+    Playlist playlist;
+    std::multiset<Song> reference;
+    for(int i = 0; i < 1000; i++){
+        Song song = source.next();
+        playlist.add(song.first, song.second);
+        reference.insert(song);
+    }
+    FlatPlaylist flat(playlist);
+    Songs probes;
+    for(int i = 0; i < 1003; i++){
+        probes.push_back(source.next());
+    }
+    std::vector<SongKey> keys;
+    for(const Song& probe : probes){
+        keys.emplace_back(probe.first, probe.second);
+    }
+    std::vector<bool> tree_found = playlist.searchMany(keys);
+    std::vector<bool> flat_found = flat.searchMany(keys);
+    ASSERT_EQ(tree_found.size(), probes.size());
+    ASSERT_EQ(flat_found.size(), probes.size());
+    for(size_t i = 0; i < probes.size(); i++){
+        EXPECT_EQ(tree_found[i], reference.count(probes[i]) > 0);
+        EXPECT_EQ(flat_found[i], reference.count(probes[i]) > 0);
+    }
+}
+
+TEST(PlaylistTest, ShortNamesLiveInTheNode){
+    EXPECT_LE(sizeof(SongNode), 128u);
+    std::string boundary_song(30, 's');
+    std::string boundary_artist(SongNode::kInlineNameBytes - boundary_song.size(), 'a');
+    std::string long_song(300, 'x');
+    std::string long_artist(SongNode::kInlineNameBytes, 'y');
+    Playlist playlist;
+    playlist.add("Nights", "Frank Ocean");
+    playlist.add(boundary_song, boundary_artist);
+    EXPECT_EQ(playlist.stats().string_bytes_, 0u);
+    playlist.add(boundary_song + "!", boundary_artist);
+    playlist.add(long_song, "Frank Ocean");
+    playlist.add("Humble", long_artist);
+    playlist.add("", "nobody");
+    EXPECT_GT(playlist.stats().string_bytes_, 0u);
+    playlist.enableArtistIndex();
+
+    Songs expected = {{"Humble", long_artist}, {"Nights", "Frank Ocean"}, {boundary_song, boundary_artist},
+        {boundary_song + "!", boundary_artist}, {long_song, "Frank Ocean"}};
+    EXPECT_EQ(songsOf(playlist), expected);
+    EXPECT_TRUE(playlist.search(long_song, "Frank Ocean"));
+    EXPECT_TRUE(playlist.search(boundary_song + "!", boundary_artist));
+    EXPECT_EQ(songsOf(playlist.findByArtist("Frank Ocean")), (Songs{{"Nights", "Frank Ocean"}, {long_song, "Frank Ocean"}}));
+    EXPECT_EQ(songsOf(playlist.findByArtist(long_artist)), (Songs{{"Humble", long_artist}}));
+
+    //a copy shares the nodes until it changes them, then copies short names and views spilled ones
+    Playlist copy(playlist);
+    copy.add(long_song, "Frank Ocean", 2);
+    copy.add(boundary_song, boundary_artist);
+    copy.remove("Nights", "Frank Ocean");
+    playlist.clear();
+    EXPECT_EQ(copy.getCount(long_song, "Frank Ocean"), 3u);
+    EXPECT_EQ(copy.getCount(boundary_song, boundary_artist), 2u);
+    EXPECT_EQ(songsOf(copy), (Songs{{"Humble", long_artist}, {boundary_song, boundary_artist},
+        {boundary_song + "!", boundary_artist}, {long_song, "Frank Ocean"}}));
+}
+
+TEST(PlaylistTest, StringViewLookupsDoNotAllocate){
+    SongSource source(14);
+    Playlist playlist;
+    ConcurrentPlaylist concurrent(8);
+    for(int i = 0; i < 2000; i++){
+        Song song = source.next();
+        playlist.add(song.first, song.second);
+        concurrent.add(song.first, song.second);
+    }
+    playlist.add("song 42", "artist 3");
+    concurrent.add("song 42", "artist 3");
+    playlist.enableArtistIndex();
+    FlatPlaylist flat(playlist);
+
+    //a request parser hands over slices of its buffer, nothing is copied into a std::string on the way down
+    std::string buffer = "song 42|artist 3|song 4200|artist 3";
+    std::string_view hit_song(buffer.data(), 7);
+    std::string_view hit_artist(buffer.data() + 8, 8);
+    std::string_view miss_song(buffer.data() + 17, 9);
+    std::string_view miss_artist(buffer.data() + 27, 8);
+    size_t before = allocation_count.load();
+    bool hit = playlist.search(hit_song, hit_artist);
+    bool miss = playlist.search(miss_song, miss_artist);
+    size_t count = playlist.getCount(hit_song, hit_artist);
+    size_t rank = playlist.rankOf(miss_song, miss_artist);
+    bool bumped = playlist.add(hit_song, hit_artist);
+    bool removed = playlist.remove(miss_song, miss_artist);
+    bool concurrent_hit = concurrent.search(hit_song, hit_artist);
+    bool concurrent_miss = concurrent.search(miss_song, miss_artist);
+    bool flat_hit = flat.search(hit_song, hit_artist);
+    size_t flat_rank = flat.rankOf(miss_song, miss_artist);
+    size_t allocations = allocation_count.load() - before;
+
+    EXPECT_EQ(allocations, 0u);
+    EXPECT_TRUE(hit);
+    EXPECT_FALSE(miss);
+    EXPECT_GE(count, 1u);
+    EXPECT_EQ(rank, flat_rank);
+    EXPECT_TRUE(bumped);
+    EXPECT_FALSE(removed);
+    EXPECT_TRUE(concurrent_hit);
+    EXPECT_FALSE(concurrent_miss);
+    EXPECT_TRUE(flat_hit);
+    EXPECT_EQ(playlist.getCount(hit_song, hit_artist), count + 1);
+}
+
+namespace {
+
+/**
+ * @brief Check union, intersection and difference of two Playlists against std::set_* over their songs and against
+ * the counts each operation should give
+ */
+void expectSetOperations(const Playlist& first, const Playlist& second, size_t threads, size_t min_songs_per_thread){
+    Songs a_songs = songsOf(first);
+    Songs b_songs = songsOf(second);
+    Songs union_songs;
+    Songs intersection_songs;
+    Songs difference_songs;
+    std::set_union(a_songs.begin(), a_songs.end(), b_songs.begin(), b_songs.end(), std::back_inserter(union_songs));
+    std::set_intersection(a_songs.begin(), a_songs.end(), b_songs.begin(), b_songs.end(), std::back_inserter(intersection_songs));
+    std::set_difference(a_songs.begin(), a_songs.end(), b_songs.begin(), b_songs.end(), std::back_inserter(difference_songs));
+
+    //counts add up in a union, the smaller one is kept in an intersection and this side's in a difference
+    std::map<Song, size_t> a = countsOf(first);
+    std::map<Song, size_t> b = countsOf(second);
+    std::map<Song, size_t> expected = a;
+    for(const auto& entry : b){
+        expected[entry.first] += entry.second;
+    }
+    Playlist united = first.unionWith(second, threads, min_songs_per_thread);
+    EXPECT_EQ(songsOf(united), union_songs);
+    EXPECT_EQ(countsOf(united), expected);
+    expected.clear();
+    for(const auto& entry : a){
+        if(b.count(entry.first) > 0){
+            expected[entry.first] = std::min(entry.second, b[entry.first]);
+        }
+    }
+    Playlist intersection = first.intersect(second, threads, min_songs_per_thread);
+    EXPECT_EQ(songsOf(intersection), intersection_songs);
+    EXPECT_EQ(countsOf(intersection), expected);
+    expected.clear();
+    for(const auto& entry : a){
+        if(b.count(entry.first) == 0){
+            expected[entry.first] = entry.second;
+        }
+    }
+    Playlist difference = first.difference(second, threads, min_songs_per_thread);
+    EXPECT_EQ(songsOf(difference), difference_songs);
+    EXPECT_EQ(countsOf(difference), expected);
+    expectBalanced(united);
+    expectBalanced(difference);
+}
+
+}
+
+TEST(PlaylistTest, SetOperations){
+    SongSource source(7);
+    Playlist first;
+    Playlist second;
+    for(int i = 0; i < 3000; i++){
+        Song song = source.next();
+        first.add(song.first, song.second);
+        song = source.next();
+        second.add(song.first, song.second);
+    }
+    expectSetOperations(first, second, 1, Playlist::kMinSongsPerThread);
+    expectSetOperations(second, first, 1, Playlist::kMinSongsPerThread);
+    expectSetOperations(first, Playlist(), 1, Playlist::kMinSongsPerThread);
+    expectSetOperations(Playlist(), first, 1, Playlist::kMinSongsPerThread);
+}
+
+TEST(PlaylistTest, ParallelSetOperationsMatchSequentialMerge){
+    //a small minimum run forces the inputs into several runs merged on their own threads
+    SongSource source(17);
+    Playlist repeated;
+    Playlist sparse;
+    for(int i = 0; i < 6000; i++){
+        //most songs of the larger playlist are added several times, so the cuts land on repeated songs, and the
+        //same songs keep turning up in the smaller one
+        Song song = source.next();
+        repeated.add(song.first, song.second, 1 + source.below(3));
+        if(i % 5 == 0){
+            song = source.next();
+            sparse.add(song.first, song.second);
+        }
+    }
+    //every song of tail sorts after every cut of head, so all but the last run get nothing from it
+    Playlist head;
+    Playlist tail;
+    char name[32];
+    for(int i = 0; i < 2000; i++){
+        std::snprintf(name, sizeof(name), "a %05d", i);
+        head.add(name, "artist", 2);
+    }
+    for(int i = 0; i < 20; i++){
+        std::snprintf(name, sizeof(name), "z %05d", i);
+        tail.add(name, "artist");
+    }
+    tail.add("a 01999", "artist");
+    for(size_t threads : {2u, 3u, 4u, 8u}){
+        for(size_t min_songs_per_thread : {1u, 7u, 500u}){
+            SCOPED_TRACE("threads " + std::to_string(threads) + ", min songs per thread " + std::to_string(min_songs_per_thread));
+            expectSetOperations(repeated, sparse, threads, min_songs_per_thread);
+            expectSetOperations(sparse, repeated, threads, min_songs_per_thread);
+            expectSetOperations(head, tail, threads, min_songs_per_thread);
+            expectSetOperations(tail, head, threads, min_songs_per_thread);
+            expectSetOperations(repeated, repeated, threads, min_songs_per_thread);
+            expectSetOperations(repeated, Playlist(), threads, min_songs_per_thread);
+        }
+    }
+}
+
+TEST(PlaylistTest, ParallelReduceMatchesSequentialWalk){
+    SongSource source(8);
+    Playlist playlist;
+    for(int i = 0; i < 5000; i++){
+        Song song = source.next();
+        playlist.add(song.first, song.second);
+    }
+    using Counts = std::unordered_map<std::string_view, size_t>;
+    using Titles = std::vector<std::string_view>;
+    Counts expected_counts;
+    Titles expected_titles;
+    for(const SongNode& song : playlist){
+        expected_counts[song.artist()]++;
+        if(song.song().back() == '7'){
+            expected_titles.push_back(song.song());
+        }
+    }
+    for(size_t threads : {1u, 2u, 4u}){
+        ThreadPool pool(threads);
+        Counts counts = playlist.reduceParallel(pool, Counts(),
+            [](Counts& partial, const SongNode& song){ partial[song.artist()]++; },
+            [](Counts left, Counts right){
+                for(const auto& entry : right){
+                    left[entry.first] += entry.second;
+                }
+                return left;
+            });
+        EXPECT_EQ(counts, expected_counts);
+        Titles titles = playlist.reduceParallel(pool, Titles(),
+            [](Titles& partial, const SongNode& song){
+                if(song.song().back() == '7'){
+                    partial.push_back(song.song());
+                }
+            },
+            [](Titles left, Titles right){
+                left.insert(left.end(), right.begin(), right.end());
+                return left;
+            });
+        EXPECT_EQ(titles, expected_titles);
+        std::atomic<size_t> visited{0};
+        playlist.forEachParallel(pool, [&visited](const SongNode&){ visited++; });
+        EXPECT_EQ(visited.load(), playlist.getNumberOfSongs());
+    }
+}
+
+TEST(PlaylistStatsTest, RecordsOperationsWhenBuiltWithInstrumentation){
+    Playlist playlist;
+    char name[32];
+    for(int i = 0; i < 1000; i++){
+        std::snprintf(name, sizeof(name), "song %04d", i);
+        playlist.add(name, "artist");
+    }
+    for(int i = 0; i < 1000; i += 10){
+        std::snprintf(name, sizeof(name), "song %04d", i);
+        playlist.search(name, "artist");
+        playlist.search(name, "nobody");
+    }
+    for(int i = 0; i < 5; i++){
+        std::snprintf(name, sizeof(name), "song %04d", i);
+        playlist.remove(name, "artist");
+    }
+    PlaylistStatsSnapshot stats = playlist.stats();
+    EXPECT_EQ(stats.songs_, 995u);
+    EXPECT_EQ(stats.height_, playlist.getHeight());
+    EXPECT_EQ(stats.live_nodes_, 995u);
+    //every name is short enough to live in its node
+    EXPECT_EQ(stats.string_bytes_, 0u);
+    EXPECT_NE(stats.toJson().find("\"songs\":995"), std::string::npos);
+    EXPECT_NE(stats.toText().find("height: " + std::to_string(playlist.getHeight())), std::string::npos);
+#ifdef PLAYLIST_INSTRUMENTATION
+    EXPECT_TRUE(stats.enabled_);
+    const OperationStats& search = stats.operation(TracedOperation::Search);
+    EXPECT_EQ(search.calls_, 200u);
+    EXPECT_EQ(search.key_bytes_, 100u * (15 + 15));
+    //every search steps through at least one node and at most one per level
+    EXPECT_GE(search.nodes_visited_, search.calls_);
+    EXPECT_LE(search.nodes_visited_, search.calls_ * playlist.getHeight());
+    EXPECT_EQ(search.key_comparisons_, search.nodes_visited_);
+    EXPECT_GE(search.sampled_calls_, 1u);
+    EXPECT_GT(search.latencyPercentile(0.99), 0u);
+    EXPECT_EQ(stats.operation(TracedOperation::Add).calls_, 1000u);
+    EXPECT_EQ(stats.operation(TracedOperation::Remove).calls_, 5u);
+    EXPECT_EQ(stats.nodes_allocated_, 1000u);
+    EXPECT_EQ(stats.nodes_freed_, 5u);
+    EXPECT_NE(stats.toJson().find("\"search\":{\"calls\":200"), std::string::npos);
+    playlist.resetStats();
+    EXPECT_EQ(playlist.stats().operation(TracedOperation::Search).calls_, 0u);
+    //a remove on a playlist that shares its nodes with a copy looks the song up first, without counting a search
+    Playlist copy = playlist;
+    playlist.remove("no such song", "nobody");
+    PlaylistStatsSnapshot after_remove = playlist.stats();
+    EXPECT_EQ(after_remove.operation(TracedOperation::Remove).calls_, 1u);
+    EXPECT_EQ(after_remove.operation(TracedOperation::Search).calls_, 0u);
+#else
+    EXPECT_FALSE(stats.enabled_);
+    EXPECT_EQ(stats.operation(TracedOperation::Search).calls_, 0u);
+#endif
+}
+
+TEST(PlaylistStatsTest, ConcurrentSearchesAreAllCounted){
+    Playlist playlist;
+    char name[32];
+    for(int i = 0; i < 1000; i++){
+        std::snprintf(name, sizeof(name), "song %04d", i);
+        playlist.add(name, "artist");
+    }
+    //searches only read the tree, so several threads may run them on one Playlist at once like ConcurrentPlaylist does
+    constexpr size_t kThreads = 8;
+    constexpr size_t kSearchesPerThread = 100000;
+    std::vector<std::thread> threads;
+    for(size_t t = 0; t < kThreads; t++){
+        threads.emplace_back([&playlist, t](){
+            char probe[32];
+            for(size_t i = 0; i < kSearchesPerThread; i++){
+                std::snprintf(probe, sizeof(probe), "song %04zu", (i * 7 + t) % 1000);
+                playlist.search(probe, "artist");
+            }
+        });
+    }
+    for(std::thread& thread : threads){
+        thread.join();
+    }
+    PlaylistStatsSnapshot stats = playlist.stats();
+    const OperationStats& search = stats.operation(TracedOperation::Search);
+#ifdef PLAYLIST_INSTRUMENTATION
+    EXPECT_EQ(search.calls_, kThreads * kSearchesPerThread);
+    EXPECT_EQ(search.key_bytes_, kThreads * kSearchesPerThread * (9 + 6));
+    EXPECT_GE(search.nodes_visited_, search.calls_);
+#else
+    EXPECT_EQ(search.calls_, 0u);
+#endif
+}
+
+TEST(PlaylistStatsTest, LatencyPercentilesComeFromTheHistogram){
+    OperationStats stats;
+    EXPECT_EQ(stats.latencyPercentile(0.5), 0u);
+    //90 calls between 64 and 127 ns, 10 between 1024 and 2047 ns
+    stats.latency_ns_[6] = 90;
+    stats.latency_ns_[10] = 10;
+    stats.sampled_calls_ = 100;
+    EXPECT_EQ(stats.latencyPercentile(0.5), 128u);
+    EXPECT_EQ(stats.latencyPercentile(0.9), 128u);
+    EXPECT_EQ(stats.latencyPercentile(0.99), 2048u);
+}
+
+TEST(ThreadPoolTest, RethrowsTaskErrorsAndRunsNestedBatches){
+    ThreadPool pool(3);
+    std::vector<std::function<void()>> tasks;
+    for(int i = 0; i < 10; i++){
+        tasks.push_back([i](){
+            if(i == 4){
+                throw std::runtime_error("task failed");
+            }
+        });
+    }
+    EXPECT_THROW(pool.runAll(tasks), std::runtime_error);
+    std::atomic<int> inner_runs{0};
+    std::vector<std::function<void()>> outer;
+    for(int i = 0; i < 4; i++){
+        outer.push_back([&pool, &inner_runs](){
+            std::vector<std::function<void()>> inner(4, [&inner_runs](){ inner_runs++; });
+            pool.runAll(inner);
+        });
+    }
+    pool.runAll(outer);
+    EXPECT_EQ(inner_runs.load(), 16);
+}
+
+TEST(StringPoolTest, InternSharesEqualText){
+    StringPool strings;
+    std::string_view first = strings.intern("Frank Ocean");
+    std::string_view second = strings.intern(std::string("Frank ") + "Ocean");
+    EXPECT_EQ(first.data(), second.data());
+    EXPECT_NE(strings.store("Frank Ocean").data(), first.data());
+    EXPECT_EQ(strings.internedCount(), 1u);
+    EXPECT_EQ(strings.bytesUsed(), 22u);
+    std::string long_name(100000, 'x');
+    EXPECT_EQ(strings.store(long_name), long_name);
+    EXPECT_EQ(first, "Frank Ocean");
+    strings.clear();
+    EXPECT_EQ(strings.bytesUsed(), 0u);
+    EXPECT_EQ(strings.internedCount(), 0u);
+}
+
+TEST(FlatPlaylistTest, MatchesPlaylist){
+    SongSource source(9);
+    Playlist playlist;
+    std::multiset<Song> reference;
+    for(int i = 0; i < 3000; i++){
+        Song song = source.next();
+        playlist.add(song.first, song.second);
+        reference.insert(song);
+    }
+    FlatPlaylist flat(playlist);
+    playlist.clear();
+    EXPECT_EQ(songsOf(flat), songsOf(reference));
+    Songs sorted = songsOf(reference);
+    for(int i = 0; i < 2000; i++){
+        Song probe = source.next();
+        EXPECT_EQ(flat.search(probe.first, probe.second), reference.count(probe) > 0);
+        EXPECT_EQ(flat.rankOf(probe.first, probe.second),
+            static_cast<size_t>(std::lower_bound(sorted.begin(), sorted.end(), probe) - sorted.begin()));
+    }
+    EXPECT_EQ(flat.at(10).song_, sorted[10].first);
+    EXPECT_THROW(flat.at(sorted.size()), std::out_of_range);
+    EXPECT_FALSE(FlatPlaylist().search("a", "b"));
+}
+
+TEST(ConcurrentPlaylistTest, ParallelWritersAndSnapshot){
+    ConcurrentPlaylist playlist(8);
+    std::vector<std::thread> writers;
+    for(int t = 0; t < 4; t++){
+        writers.emplace_back([&playlist, t](){
+            for(int i = 0; i < 1000; i++){
+                playlist.add("song " + std::to_string(i), "artist " + std::to_string(t));
+            }
+            for(int i = 0; i < 1000; i += 2){
+                playlist.remove("song " + std::to_string(i), "artist " + std::to_string(t));
+            }
+        });
+    }
+    for(std::thread& writer : writers){
+        writer.join();
+    }
+    EXPECT_EQ(playlist.getNumberOfSongs(), 2000u);
+    EXPECT_TRUE(playlist.search("song 1", "artist 3"));
+    EXPECT_FALSE(playlist.search("song 2", "artist 3"));
+    playlist.add("song 1", "artist 3");
+    Playlist snapshot = playlist.snapshot();
+    EXPECT_EQ(snapshot.getNumberOfSongs(), 2000u);
+    EXPECT_EQ(snapshot.getCount("song 1", "artist 3"), 2u);
+    playlist.clear();
+    EXPECT_TRUE(playlist.isEmpty());
+    EXPECT_EQ(snapshot.getNumberOfSongs(), 2000u);
+}
+
+TEST(PlaylistImageTest, SaveAndMapRoundTrip){
+    SongSource source(10);
+    Playlist playlist;
+    for(int i = 0; i < 1000; i++){
+        Song song = source.next();
+        playlist.add(song.first, song.second, 1 + source.below(4));
+    }
+    std::string path = ::testing::TempDir() + "playlist_image_test.img";
+    PlaylistImage::save(playlist, path);
+    {
+        PlaylistImage image(path);
+        EXPECT_EQ(image.getNumberOfSongs(), playlist.getNumberOfSongs());
+        EXPECT_EQ(songsOf(image), songsOf(playlist));
+        //the counts of repeated adds survive the round trip
+        std::map<Song, size_t> counts;
+        for(SongKey song : image){
+            counts[songOf(song)] = image.getCount(song.song_, song.artist_);
+        }
+        EXPECT_EQ(counts, countsOf(playlist));
+        EXPECT_EQ(image.getCount("no such song", "nobody"), 0u);
+        EXPECT_TRUE(image.search("song 1", std::string(playlist.at(0).artist())) == playlist.search("song 1", std::string(playlist.at(0).artist())));
+        PlaylistImage moved = std::move(image);
+        EXPECT_EQ(moved.at(5).song_, playlist.at(5).song());
+        EXPECT_THROW(moved.at(moved.getNumberOfSongs()), std::out_of_range);
+    }
+    //every artist is stored once, so the file is smaller than the names of every song and its artist
+    size_t name_bytes = 0;
+    for(const SongNode& song : playlist){
+        name_bytes += song.song().size() + song.artist().size();
+    }
+    struct stat image_stat;
+    ASSERT_EQ(::stat(path.c_str(), &image_stat), 0);
+    EXPECT_LT(static_cast<size_t>(image_stat.st_size), name_bytes + playlist.getNumberOfSongs() * 24);
+
+    //a save that fails leaves the last good image in place and no temporary file, here a file size limit stops the write
+    Playlist other;
+    for(int i = 0; i < 100; i++){
+        other.add("song " + std::to_string(i), "Frank Ocean");
+    }
+    rlimit original;
+    ASSERT_EQ(::getrlimit(RLIMIT_FSIZE, &original), 0);
+    auto previous_handler = std::signal(SIGXFSZ, SIG_IGN);
+    rlimit limited = original;
+    limited.rlim_cur = 64;
+    ASSERT_EQ(::setrlimit(RLIMIT_FSIZE, &limited), 0);
+    EXPECT_THROW(PlaylistImage::save(other, path), std::runtime_error);
+    ::setrlimit(RLIMIT_FSIZE, &original);
+    std::signal(SIGXFSZ, previous_handler);
+    EXPECT_EQ(songsOf(PlaylistImage(path)), songsOf(playlist));
+    size_t slash = path.rfind('/');
+    std::string prefix = path.substr(slash + 1) + ".";
+    DIR* directory = ::opendir(path.substr(0, slash).c_str());
+    ASSERT_NE(directory, nullptr);
+    while(dirent* entry = ::readdir(directory)){
+        EXPECT_NE(std::string(entry->d_name).rfind(prefix, 0), 0u) << entry->d_name;
+    }
+    ::closedir(directory);
+
+    std::FILE* file = std::fopen(path.c_str(), "wb");
+    std::fputs("not an image", file);
+    std::fclose(file);
+    EXPECT_THROW(PlaylistImage image(path), std::runtime_error);
+    std::remove(path.c_str());
+}
+
+TEST(PlaylistCsvTest, ImportExportRoundTrip){
+    std::istringstream in("Humble,Kendrick Lamar\n\"Hello, \"\"World\"\"\",Someone\r\nbad line\n,Nobody\nNights,Frank Ocean\nHumble,Kendrick Lamar\n");
+    Playlist playlist;
+    CsvImportStats stats = PlaylistCsv::importFrom(in, playlist, ',', 2);
+    EXPECT_EQ(stats.records_read_, 6u);
+    EXPECT_EQ(stats.songs_added_, 3u);
+    EXPECT_EQ(stats.records_rejected_, 2u);
+    EXPECT_TRUE(playlist.search("Hello, \"World\"", "Someone"));
+    std::ostringstream out;
+    PlaylistCsv::exportTo(playlist, out, '\t');
+    std::istringstream back(out.str());
+    Playlist reloaded;
+    PlaylistCsv::importFrom(back, reloaded, '\t');
+    EXPECT_EQ(countsOf(reloaded), countsOf(playlist));
+    EXPECT_EQ(reloaded.getCount("Humble", "Kendrick Lamar"), 2u);
+
+    //a song added many times is one record with a count, not one record per add
+    Playlist repeated;
+    repeated.add("Humble", "Kendrick Lamar", 1000000);
+    repeated.add("Nights", "Frank Ocean");
+    std::ostringstream repeated_out;
+    PlaylistCsv::exportTo(repeated, repeated_out);
+    EXPECT_EQ(repeated_out.str(), "Humble,Kendrick Lamar,1000000\nNights,Frank Ocean\n");
+    std::istringstream counted("Humble,Kendrick Lamar,1000000\nNights,Frank Ocean\nNights,Frank Ocean,2\nbad,count,0\nbad,count,x\nbad,count,3,4\n");
+    Playlist counted_playlist;
+    CsvImportStats counted_stats = PlaylistCsv::importFrom(counted, counted_playlist, ',', 2);
+    EXPECT_EQ(counted_stats.songs_added_, 2u);
+    EXPECT_EQ(counted_stats.records_rejected_, 3u);
+    EXPECT_EQ(counted_playlist.getCount("Humble", "Kendrick Lamar"), 1000000u);
+    EXPECT_EQ(counted_playlist.getCount("Nights", "Frank Ocean"), 3u);
+
+    //only a \r right before a \n is a line ending, a bare one stays in its field and survives a round trip
+    std::istringstream carriage_returns("Ni\rghts,Frank Ocean\r\nHumble\r,Kendrick Lamar\nEspresso,Sabrina Carpenter\r");
+    Playlist returns;
+    EXPECT_EQ(PlaylistCsv::importFrom(carriage_returns, returns).songs_added_, 3u);
+    EXPECT_TRUE(returns.search("Ni\rghts", "Frank Ocean"));
+    EXPECT_TRUE(returns.search("Humble\r", "Kendrick Lamar"));
+    EXPECT_TRUE(returns.search("Espresso", "Sabrina Carpenter"));
+    std::ostringstream returns_out;
+    PlaylistCsv::exportTo(returns, returns_out);
+    std::istringstream returns_back(returns_out.str());
+    Playlist returns_reloaded;
+    PlaylistCsv::importFrom(returns_back, returns_reloaded);
+    EXPECT_EQ(countsOf(returns_reloaded), countsOf(returns));
+}
+
+namespace {
+
+/**
+ * @brief A journal directory under the test temp dir that is emptied before and after the test
+ */
+class JournalDirectory {
+    public:
+        explicit JournalDirectory(const std::string& name) : path_(::testing::TempDir() + name) {
+            removeFiles();
+        }
+
+        ~JournalDirectory(){
+            removeFiles();
+        }
+
+        const std::string& path() const { return path_; }
+        std::string log() const { return path_ + "/playlist.log"; }
+
+    private:
+        void removeFiles(){
+            for(const char* file : {"/playlist.log", "/playlist.snapshot", "/playlist.log.tmp", "/playlist.snapshot.tmp", ""}){
+                std::remove((path_ + file).c_str());
+            }
+        }
+
+        std::string path_;
+};
+
+std::string readFile(const std::string& path){
+    std::ifstream in(path, std::ios::binary);
+    return std::string(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+}
+
+}
+
+TEST(PlaylistJournalTest, RecoversEveryChangeAfterReopen){
+    JournalDirectory directory("playlist_journal_reopen");
+    SongSource source(12);
+    std::map<Song, size_t> expected;
+    for(SyncPolicy sync : {SyncPolicy::None, SyncPolicy::Group, SyncPolicy::Always}){
+        JournalOptions options;
+        options.sync_ = sync;
+        options.group_size_ = 7;
+        PlaylistJournal journal(directory.path(), options);
+        EXPECT_EQ(countsOf(journal.playlist()), expected);
+        for(int step = 0; step < 300; step++){
+            Song song = source.next();
+            if(step == 150){
+                journal.clear();
+            }
+            else if(step % 3 == 0){
+                journal.remove(song.first, song.second);
+            }
+            else{
+                journal.add(song.first, song.second, 1 + step % 2);
+            }
+        }
+        EXPECT_FALSE(journal.add("", "Nobody"));
+        EXPECT_FALSE(journal.remove("Not there", "Nobody"));
+        expected = countsOf(journal.playlist());
+    }
+    PlaylistJournal reopened(directory.path());
+    EXPECT_EQ(countsOf(reopened.playlist()), expected);
+    EXPECT_EQ(reopened.generation(), 0u);
+}
+
+TEST(PlaylistJournalTest, TornTailIsCutOff){
+    JournalDirectory directory("playlist_journal_torn");
+    {
+        JournalOptions options;
+        options.sync_ = SyncPolicy::Always;
+        PlaylistJournal journal(directory.path(), options);
+        journal.add("Humble", "Kendrick Lamar");
+        journal.add("Nights", "Frank Ocean", 3);
+        journal.remove("Humble", "Kendrick Lamar");
+    }
+    //a crash in the middle of a write leaves part of a record at the end of the log
+    std::string committed = readFile(directory.log());
+    {
+        std::ofstream out(directory.log(), std::ios::binary | std::ios::app);
+        out << committed.substr(committed.size() - 20);
+    }
+    {
+        PlaylistJournal journal(directory.path());
+        EXPECT_EQ(journal.playlist().getNumberOfSongs(), 1u);
+        EXPECT_EQ(journal.playlist().getCount("Nights", "Frank Ocean"), 3u);
+        EXPECT_EQ(journal.logBytes(), committed.size());
+        journal.add("Espresso", "Sabrina Carpenter");
+    }
+    //the torn bytes were cut off, so the record written after them is replayed too
+    PlaylistJournal reopened(directory.path());
+    EXPECT_EQ(reopened.playlist().getNumberOfSongs(), 2u);
+    EXPECT_TRUE(reopened.playlist().search("Espresso", "Sabrina Carpenter"));
+}
+
+TEST(PlaylistJournalTest, FailedCommitLeavesNoPartialRecords){
+    JournalDirectory directory("playlist_journal_failed_commit");
+    JournalOptions options;
+    options.group_size_ = 1000;
+    {
+        PlaylistJournal journal(directory.path(), options);
+        journal.add("Humble", "Kendrick Lamar");
+        journal.commit();
+        size_t committed = journal.logBytes();
+
+        //a file size limit just past the log makes the next write stop halfway through the group, like a full disk
+        rlimit original;
+        ASSERT_EQ(::getrlimit(RLIMIT_FSIZE, &original), 0);
+        auto previous_handler = std::signal(SIGXFSZ, SIG_IGN);
+        rlimit limited = original;
+        limited.rlim_cur = committed + 30;
+        ASSERT_EQ(::setrlimit(RLIMIT_FSIZE, &limited), 0);
+        journal.add("Nights", "Frank Ocean", 2);
+        journal.add("Espresso", "Sabrina Carpenter");
+        EXPECT_THROW(journal.commit(), std::runtime_error);
+        ::setrlimit(RLIMIT_FSIZE, &original);
+        std::signal(SIGXFSZ, previous_handler);
+
+        //the half written group was cut off, so committing again writes it once and in one piece
+        EXPECT_EQ(journal.logBytes(), committed);
+        EXPECT_EQ(readFile(directory.log()).size(), committed);
+        journal.commit();
+        journal.add("Ocean Eyes", "Billie Eilish");
+    }
+    PlaylistJournal reopened(directory.path());
+    EXPECT_EQ(reopened.playlist().getNumberOfSongs(), 4u);
+    EXPECT_EQ(reopened.playlist().getCount("Nights", "Frank Ocean"), 2u);
+    EXPECT_EQ(reopened.playlist().getCount("Espresso", "Sabrina Carpenter"), 1u);
+    EXPECT_TRUE(reopened.playlist().search("Ocean Eyes", "Billie Eilish"));
+}
+
+TEST(PlaylistJournalTest, CompactionKeepsCountsAndSkipsFoldedLogs){
+    JournalDirectory directory("playlist_journal_compact");
+    SongSource source(13);
+    std::map<Song, size_t> expected;
+    {
+        JournalOptions options;
+        options.group_size_ = 16;
+        options.compact_after_bytes_ = 4096;
+        PlaylistJournal journal(directory.path(), options);
+        for(int i = 0; i < 2000; i++){
+            Song song = source.next();
+            journal.add(song.first, song.second);
+        }
+        EXPECT_GT(journal.generation(), 0u);
+        EXPECT_LT(journal.logBytes(), 2000 * 40u);
+        expected = countsOf(journal.playlist());
+    }
+    {
+        PlaylistJournal journal(directory.path());
+        EXPECT_EQ(countsOf(journal.playlist()), expected);
+        journal.add("Nights", "Frank Ocean", 5);
+        //a crash right after the snapshot is renamed into place leaves the log that was folded into it
+        journal.commit();
+        std::string folded = readFile(directory.log());
+        journal.compact();
+        std::ofstream(directory.log(), std::ios::binary | std::ios::trunc) << folded;
+        expected = countsOf(journal.playlist());
+    }
+    PlaylistJournal reopened(directory.path());
+    EXPECT_EQ(countsOf(reopened.playlist()), expected);
+    EXPECT_EQ(reopened.playlist().getCount("Nights", "Frank Ocean"), 5u);
+}
+
+TEST(PlaylistJournalTest, FailureAfterSnapshotRenameStopsTheJournal){
+    JournalDirectory directory("playlist_journal_compact_failure");
+    std::map<Song, size_t> expected;
+    {
+        PlaylistJournal journal(directory.path());
+        journal.add("Nights", "Frank Ocean", 2);
+        journal.add("Humble", "Kendrick Lamar");
+        uint64_t generation = journal.generation();
+        //a directory where the new log is written aside makes startLog fail once the snapshot has been renamed into place
+        ASSERT_EQ(::mkdir((directory.log() + ".tmp").c_str(), 0755), 0);
+        EXPECT_THROW(journal.compact(), std::runtime_error);
+        ::rmdir((directory.log() + ".tmp").c_str());
+        EXPECT_EQ(journal.generation(), generation);
+        //the open log is a generation behind the snapshot, so a change appended to it would be skipped on recovery
+        EXPECT_THROW(journal.add("Espresso", "Sabrina Carpenter"), std::runtime_error);
+        EXPECT_THROW(journal.commit(), std::runtime_error);
+        EXPECT_THROW(journal.compact(), std::runtime_error);
+        expected = countsOf(journal.playlist());
+    }
+    PlaylistJournal reopened(directory.path());
+    EXPECT_EQ(countsOf(reopened.playlist()), expected);
+    EXPECT_EQ(reopened.playlist().getCount("Nights", "Frank Ocean"), 2u);
+    reopened.add("Espresso", "Sabrina Carpenter");
+    reopened.commit();
+    EXPECT_EQ(PlaylistJournal(directory.path()).playlist().getNumberOfSongs(), 3u);
+}
@@ -0,0 +1,76 @@
+/**
+ * @file StringPool.cpp
+ * @brief This is the implementation file of the StringPool interface
+ * @version 0.1
+ * @date 2024-07-14
+ * 
+ * @copyright Copyright (c) 2024
+ * 
+ */
+#include "StringPool.hpp"
+
+#include <cstring>
+
+StringPool::StringPool() : current_chunk_(nullptr), chunk_used_(kChunkSize), bytes_used_(0), bytes_reserved_(0){
+}
+
+std::string_view StringPool::intern(std::string_view text){
+    auto found = interned_.find(text);
+    if(found != interned_.end()){
+        return *found;
+    }
+    std::string_view stored = copyIn(text);
+    interned_.insert(stored);
+    return stored;
+}
+
+std::string_view StringPool::store(std::string_view text){
+    return copyIn(text);
+}
+
+void StringPool::clear(){
+    interned_.clear();
+    chunks_.clear();
+    current_chunk_ = nullptr;
+    chunk_used_ = kChunkSize;
+    bytes_used_ = 0;
+    bytes_reserved_ = 0;
+}
+
+size_t StringPool::bytesUsed() const{
+    return bytes_used_;
+}
+
+size_t StringPool::bytesReserved() const{
+    //each table entry is a view plus the node and bucket the hash set keeps for it
+    return bytes_reserved_ + interned_.size() * (sizeof(std::string_view) + 2 * sizeof(void*)) + interned_.bucket_count() * sizeof(void*);
+}
+
+size_t StringPool::internedCount() const{
+    return interned_.size();
+}
+
+std::string_view StringPool::copyIn(std::string_view text){
+    if(text.empty()){
+        return std::string_view();
+    }
+    bytes_used_ += text.size();
+    //a text bigger than a quarter chunk gets its own chunk so it does not waste the rest of the current one
+    if(text.size() > kChunkSize / 4){
+        chunks_.emplace_back(new char[text.size()]);
+        bytes_reserved_ += text.size();
+        char* copy = chunks_.back().get();
+        std::memcpy(copy, text.data(), text.size());
+        return std::string_view(copy, text.size());
+    }
+    if(chunk_used_ + text.size() > kChunkSize){
+        chunks_.emplace_back(new char[kChunkSize]);
+        bytes_reserved_ += kChunkSize;
+        current_chunk_ = chunks_.back().get();
+        chunk_used_ = 0;
+    }
+    char* copy = current_chunk_ + chunk_used_;
+    std::memcpy(copy, text.data(), text.size());
+    chunk_used_ += text.size();
+    return std::string_view(copy, text.size());
+}
@@ -0,0 +1,92 @@
+/**
+ * @file StringPool.hpp
+ * @brief This is the interface of an arena that stores the song and artist names of a Playlist and interns repeated names
+ * @version 0.1
+ * @date 2024-07-14
+ * 
+ * @copyright Copyright (c) 2024
+ * 
+ */
+
+#ifndef STRING_POOL_H_
+#define STRING_POOL_H_
+
+#include <cstddef>
+#include <memory>
+#include <string_view>
+#include <unordered_set>
+#include <vector>
+
+/**
+ * @brief Append only storage for strings, handed out as std::string_view.
+ * 
+ * Text is copied into large chunks, so storing a name costs no heap allocation of its own and the bytes never move.
+ * intern returns the same view for equal text, so a name shared by thousands of songs is stored once. Nothing is freed
+ * until clear or destruction, so every view stays valid until then.
+ */
+class StringPool {
+    public:
+        /**
+         * @brief Default constructor for StringPool, no memory is reserved until the first string is stored
+         */
+        StringPool();
+
+        StringPool(const StringPool&) = delete;
+        StringPool& operator=(const StringPool&) = delete;
+
+        /**
+         * @brief Store text once and return the stored copy, or the copy stored by an earlier call with equal text
+         * @param text The text to intern
+         * @return View of the stored text, valid until clear or destruction
+         */
+        std::string_view intern(std::string_view text);
+
+        /**
+         * @brief Store text without looking for an earlier copy, for text that is rarely repeated
+         * @param text The text to store
+         * @return View of the stored text, valid until clear or destruction
+         */
+        std::string_view store(std::string_view text);
+
+        /**
+         * @brief Free every chunk at once, invalidating every view handed out
+         */
+        void clear();
+
+        /**
+         * @brief Get the number of bytes of text stored
+         * @return Bytes of text stored, each interned text counted once
+         */
+        size_t bytesUsed() const;
+
+        /**
+         * @brief Get the number of bytes held by the pool, including unused chunk space and the intern table
+         * @return Bytes held by the pool
+         */
+        size_t bytesReserved() const;
+
+        /**
+         * @brief Get the number of distinct texts interned
+         * @return Number of distinct texts passed to intern
+         */
+        size_t internedCount() const;
+
+    private:
+        static constexpr size_t kChunkSize = 1 << 16; /** Bytes in a regular chunk, longer texts get a chunk of their own */
+
+        /**
+         * @brief Copy text into the newest chunk, starting a new chunk when it does not fit
+         * @param text The text to copy
+         * @return View of the copy
+         */
+        std::string_view copyIn(std::string_view text);
+
+        std::vector<std::unique_ptr<char[]>> chunks_; /** Chunks of text, oldest first */
+        char* current_chunk_; /** Regular chunk being filled, nullptr before the first one */
+        size_t chunk_used_; /** Bytes used in the newest regular chunk */
+        size_t bytes_used_; /** Bytes of text stored */
+        size_t bytes_reserved_; /** Bytes allocated for chunks */
+        std::unordered_set<std::string_view> interned_; /** Views of every interned text, pointing into the chunks */
+};
+
+#endif//STRING_POOL_H_
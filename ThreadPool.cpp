@@ -0,0 +1,154 @@
+/**
+ * @file ThreadPool.cpp
+ * @brief This is the implementation file of the ThreadPool interface
+ * @version 0.1
+ * @date 2024-07-14
+ * 
+ * @copyright Copyright (c) 2024
+ * 
+ */
+#include "ThreadPool.hpp"
+
+#include <algorithm>
+#include <exception>
+
+ThreadPool::ThreadPool(size_t threads) : queued_(0), stopping_(false){
+    if(threads == 0){
+        threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+    for(size_t i = 0; i < threads; i++){
+        workers_.push_back(std::make_unique<Worker>());
+    }
+    for(size_t i = 0; i < threads; i++){
+        threads_.emplace_back(&ThreadPool::workerLoop, this, i);
+    }
+}
+
+ThreadPool::~ThreadPool(){
+    {
+        std::lock_guard<std::mutex> lock(state_mutex_);
+        stopping_ = true;
+    }
+    work_ready_.notify_all();
+    for(std::thread& thread : threads_){
+        thread.join();
+    }
+}
+
+size_t ThreadPool::size() const{
+    return workers_.size();
+}
+
+namespace {
+
+/**
+ * @brief What the tasks of one batch share with the thread waiting for it
+ */
+struct Batch {
+    std::atomic<size_t> remaining_; /** Tasks not finished yet */
+    std::mutex mutex_; /** Guards error_ and done_ */
+    std::condition_variable finished_; /** Signalled once done_ is set */
+    std::exception_ptr error_; /** The first exception thrown by a task */
+    bool done_ = false; /** Set by the last task to finish */
+};
+
+}
+
+void ThreadPool::runAll(std::vector<std::function<void()>> tasks){
+    if(tasks.empty()){
+        return;
+    }
+    //the counter and the first error belong to this batch, so batches from different threads do not wait on each other
+    Batch batch;
+    batch.remaining_.store(tasks.size(), std::memory_order_relaxed);
+    for(size_t i = 0; i < tasks.size(); i++){
+        std::function<void()> wrapped = [task = std::move(tasks[i]), &batch]() mutable{
+            std::exception_ptr thrown;
+            try{
+                task();
+            }
+            catch(...){
+                thrown = std::current_exception();
+            }
+            //whatever the task captured is released before the batch can be seen as done
+            task = nullptr;
+            if(thrown != nullptr){
+                std::lock_guard<std::mutex> lock(batch.mutex_);
+                if(batch.error_ == nullptr){
+                    batch.error_ = thrown;
+                }
+            }
+            //only the last task takes the lock, and it is the last to touch the batch before runAll may return
+            if(batch.remaining_.fetch_sub(1, std::memory_order_acq_rel) == 1){
+                std::lock_guard<std::mutex> lock(batch.mutex_);
+                batch.done_ = true;
+                batch.finished_.notify_all();
+            }
+        };
+        //count the task under the lock of the queue it goes in, the same lock takeTask holds when it uncounts it
+        Worker& worker = *workers_[i % workers_.size()];
+        std::lock_guard<std::mutex> lock(worker.mutex_);
+        worker.tasks_.push_back(std::move(wrapped));
+        queued_.fetch_add(1);
+    }
+    //a worker checks queued_ under state_mutex_ before it sleeps, so passing through the lock here means it either
+    //saw the new tasks or is already waiting and gets the notification
+    {
+        std::lock_guard<std::mutex> lock(state_mutex_);
+    }
+    work_ready_.notify_all();
+
+    //help out instead of sleeping, then wait for tasks the workers are still running
+    std::function<void()> task;
+    while(takeTask(size(), task)){
+        task();
+        task = nullptr;
+    }
+    std::unique_lock<std::mutex> lock(batch.mutex_);
+    batch.finished_.wait(lock, [&batch](){ return batch.done_; });
+    if(batch.error_ != nullptr){
+        std::rethrow_exception(batch.error_);
+    }
+}
+
+void ThreadPool::workerLoop(size_t index){
+    std::function<void()> task;
+    while(true){
+        if(takeTask(index, task)){
+            task();
+            task = nullptr;
+            continue;
+        }
+        std::unique_lock<std::mutex> lock(state_mutex_);
+        work_ready_.wait(lock, [this](){ return queued_.load() > 0 || stopping_; });
+        if(queued_.load() == 0 && stopping_){
+            return;
+        }
+    }
+}
+
+bool ThreadPool::takeTask(size_t index, std::function<void()>& task){
+    //own queue first, newest task first while it is still warm in the cache
+    if(index < workers_.size()){
+        Worker& own = *workers_[index];
+        std::lock_guard<std::mutex> lock(own.mutex_);
+        if(!own.tasks_.empty()){
+            task = std::move(own.tasks_.back());
+            own.tasks_.pop_back();
+            queued_.fetch_sub(1);
+            return true;
+        }
+    }
+    //then steal the oldest task of another worker, starting with the next one so thieves spread out
+    for(size_t i = 1; i <= workers_.size(); i++){
+        Worker& victim = *workers_[(index + i) % workers_.size()];
+        std::lock_guard<std::mutex> lock(victim.mutex_);
+        if(!victim.tasks_.empty()){
+            task = std::move(victim.tasks_.front());
+            victim.tasks_.pop_front();
+            queued_.fetch_sub(1);
+            return true;
+        }
+    }
+    return false;
+}
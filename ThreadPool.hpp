@@ -0,0 +1,95 @@
+/**
+ * @file ThreadPool.hpp
+ * @brief This is the interface of a small work stealing thread pool used to walk large playlists in parallel
+ * @version 0.1
+ * @date 2024-07-14
+ * 
+ * @copyright Copyright (c) 2024
+ * 
+ */
+
+#ifndef THREAD_POOL_H_
+#define THREAD_POOL_H_
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/**
+ * @brief A fixed set of worker threads that run batches of tasks.
+ * 
+ * Every worker has its own queue. A batch is dealt out round robin over the queues, each worker takes tasks from the
+ * back of its own queue and, once that is empty, steals from the front of the others, so a worker that drew cheap
+ * tasks helps with the rest instead of going idle. The thread that submits a batch steals too while it waits.
+ * 
+ * Queuing and taking a task only locks the queue it touches. The pool wide lock is only taken to put a worker to
+ * sleep when every queue is empty and once per batch to wake them, so workers busy with their own queues never wait
+ * on each other.
+ */
+class ThreadPool {
+    public:
+        /**
+         * @brief Constructor that starts the worker threads
+         * @param threads Number of workers, 0 means one per hardware thread
+         */
+        explicit ThreadPool(size_t threads = 0);
+
+        ThreadPool(const ThreadPool&) = delete;
+        ThreadPool& operator=(const ThreadPool&) = delete;
+
+        /**
+         * @brief Destructor for ThreadPool, waits for queued tasks to finish and joins the workers
+         */
+        ~ThreadPool();
+
+        /**
+         * @brief Get the number of worker threads
+         * @return Number of workers
+         */
+        size_t size() const;
+
+        /**
+         * @brief Run a batch of tasks and wait for all of them. Several threads may run batches at the same time
+         * @param tasks The tasks to run, in no particular order
+         * @throw The first exception thrown by a task, after every task of the batch has finished
+         */
+        void runAll(std::vector<std::function<void()>> tasks);
+
+    private:
+        /**
+         * @brief The queue of one worker, on a cache line of its own so locking it does not slow down its neighbours
+         */
+        struct alignas(64) Worker {
+            std::mutex mutex_; /** Guards tasks_ */
+            std::deque<std::function<void()>> tasks_; /** Tasks waiting to run, the owner pops the back and thieves the front */
+        };
+
+        /**
+         * @brief Body of a worker thread, runs tasks until the pool is destroyed
+         * @param index The worker the thread owns
+         */
+        void workerLoop(size_t index);
+
+        /**
+         * @brief Take a task from a worker's own queue or steal one from another queue
+         * @param index The worker looking for work, size() for a thread that owns no queue
+         * @param task Set to the task taken
+         * @return True if a task was taken
+         */
+        bool takeTask(size_t index, std::function<void()>& task);
+
+        std::vector<std::unique_ptr<Worker>> workers_; /** One queue per worker thread */
+        std::vector<std::thread> threads_; /** The worker threads */
+        std::mutex state_mutex_; /** Guards stopping_ and pairs with work_ready_ */
+        std::condition_variable work_ready_; /** Signalled when tasks are queued or the pool is stopping */
+        std::atomic<size_t> queued_; /** Tasks sitting in the queues, only changed while holding the lock of the queue */
+        bool stopping_; /** Set by the destructor to send the workers home */
+};
+
+#endif//THREAD_POOL_H_
@@ -88,20 +88,22 @@ int main(){
     sadabs_music.add("Billie Jean" , "Micheal Jackson");
     sadabs_music.add("Beat It" , "Jhonathan");
     //testing preorder traverse
-    std::vector<SongNode> songs_in_sadabs = sadabs_music.preorderTraverse();
-    for(SongNode song: songs_in_sadabs){
-        std::cout<< song.song_ <<" by "<<song.artist_ << std::endl;
+    for(const SongNode& song: sadabs_music.preorder()){
+        std::cout<< song.song() <<" by "<<song.artist() << std::endl;
     }
     std::cout<<std::endl;
-    //testing inorder
-    std::vector<SongNode> songs_in_sadabs2 = sadabs_music.inorderTraverse();
-    for(SongNode song: songs_in_sadabs2){
-        std::cout<< song.song_ <<" by "<<song.artist_ << std::endl;
+    //testing inorder, which is also what a range-for over the playlist itself does
+    for(const SongNode& song: sadabs_music){
+        std::cout<< song.song() <<" by "<<song.artist() << std::endl;
     }
     std::cout<<std::endl;
     //testing postorder
-    std::vector<SongNode> songs_in_sadabs3 = sadabs_music.postorderTraverse();
-    for(SongNode song: songs_in_sadabs3){
-        std::cout<< song.song_ <<" by "<<song.artist_ << std::endl;
+    for(const SongNode& song: sadabs_music.postorder()){
+        std::cout<< song.song() <<" by "<<song.artist() << std::endl;
     }
+    std::cout<<std::endl;
+    //the copying traversals still give the same songs
+    std::vector<SongEntry> songs_in_sadabs = sadabs_music.inorderTraverse();
+    std::cout<< "inorderTraverse copied " << songs_in_sadabs.size() << " songs" << std::endl;
+    std::cout<<std::endl;
 }
\ No newline at end of file